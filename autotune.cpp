@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "autotune.h"
+#include "cycleTimer.h"
+#include "sceneLoader.h"
+#include "tiledRenderer.h"
+#include "workerPool.h"
+
+// tile edges tried by the autotuner (MIN_SUBTILE_SIZE up to 4x the default)
+static const int tuningTileSizes[] = { 8, 16, 32, 64, 128 };
+
+
+// cpuModelName --
+//
+// "model name" of the first CPU in /proc/cpuinfo, if any.
+static std::string
+cpuModelName() {
+
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") != 0)
+            continue;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            break;
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        return start == std::string::npos ? "" : line.substr(start);
+    }
+    return "";
+}
+
+// log2Bucket --
+//
+// Nearest power of two exponent of value (at least 0).
+static int
+log2Bucket(double value) {
+    return value > 1.0 ? static_cast<int>(lround(log2(value))) : 0;
+}
+
+// splitFields --
+//
+// Tab separated fields of a line of the tuning file.
+static std::vector<std::string>
+splitFields(const std::string& line) {
+
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos)
+            return fields;
+        start = tab + 1;
+    }
+}
+
+static bool
+parseProfile(const std::string& line, TuningProfile& profile) {
+
+    if (line.empty() || line[0] == '#')
+        return false;
+    std::vector<std::string> fields = splitFields(line);
+    if (fields.size() != 5)
+        return false;
+
+    profile.host = fields[0];
+    profile.scene = fields[1];
+    return sscanf(fields[2].c_str(), "%d", &profile.tileSize) == 1 && profile.tileSize > 0 &&
+           sscanf(fields[3].c_str(), "%d", &profile.numThreads) == 1 && profile.numThreads > 0 &&
+           sscanf(fields[4].c_str(), "%lf", &profile.msPerFrame) == 1;
+}
+
+
+std::string
+tuningHostKey() {
+
+    std::string model = cpuModelName();
+    if (model.empty())
+        model = "unknown cpu";
+    // the key is a field of the tuning file
+    std::replace(model.begin(), model.end(), '\t', ' ');
+
+    unsigned int threads = std::thread::hardware_concurrency();
+    char suffix[32];
+    sprintf(suffix, " x%u", threads > 0 ? threads : 1);
+    return model + suffix;
+}
+
+std::string
+tuningSceneSignature(int numCircles, const float* radius, int width, int height,
+                     bool antialias, bool compact) {
+
+    // median radius in pixels, and the average number of circles
+    // covering a pixel (the circles' total area over the image area)
+    std::vector<float> radii(radius, radius + numCircles);
+    double medianRadius = 0.0;
+    if (numCircles > 0) {
+        std::nth_element(radii.begin(), radii.begin() + numCircles / 2, radii.end());
+        medianRadius = radii[numCircles / 2] * width;
+    }
+    double coverage = 0.0;
+    for (int i=0; i<numCircles; i++)
+        coverage += M_PI * radius[i] * radius[i];
+
+    char signature[128];
+    sprintf(signature, "n%d-r%d-o%d-%dx%d%s%s", log2Bucket(numCircles), log2Bucket(medianRadius),
+            log2Bucket(coverage), width, height, antialias ? "-aa" : "", compact ? "-compact" : "");
+    return signature;
+}
+
+bool
+findTuningProfile(const std::string& filename, const std::string& host, const std::string& scene,
+                  TuningProfile& profile) {
+
+    std::ifstream file(filename.c_str());
+    std::string line;
+    while (std::getline(file, line)) {
+        TuningProfile candidate;
+        if (parseProfile(line, candidate) && candidate.host == host && candidate.scene == scene) {
+            profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+saveTuningProfile(const std::string& filename, const TuningProfile& profile) {
+
+    // keep the other profiles (and comments), written back through a
+    // temporary file so that a failed write leaves the old file intact
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(filename.c_str());
+        std::string line;
+        while (std::getline(file, line)) {
+            TuningProfile other;
+            if (parseProfile(line, other) && other.host == profile.host && other.scene == profile.scene)
+                continue;
+            lines.push_back(line);
+        }
+    }
+    if (lines.empty())
+        lines.push_back("# host\tscene signature\ttile size\tthreads\tms per frame");
+
+    char entry[64];
+    sprintf(entry, "\t%d\t%d\t%.4f", profile.tileSize, profile.numThreads, profile.msPerFrame);
+    lines.push_back(profile.host + "\t" + profile.scene + entry);
+
+    std::string tempname = filename + ".tmp";
+    FILE* fp = fopen(tempname.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s for write\n", tempname.c_str());
+        return false;
+    }
+    for (size_t i=0; i<lines.size(); i++)
+        fprintf(fp, "%s\n", lines[i].c_str());
+    if (fclose(fp) != 0 || rename(tempname.c_str(), filename.c_str()) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", filename.c_str());
+        remove(tempname.c_str());
+        return false;
+    }
+    return true;
+}
+
+void
+applyTuningProfile(TiledRenderer* renderer, const std::string& filename, bool threadsGiven) {
+
+    std::ifstream file(filename.c_str());
+    if (!file)
+        return;
+
+    std::string host = tuningHostKey();
+    std::string scene = renderer->tuningSignature();
+    TuningProfile profile;
+    if (!findTuningProfile(filename, host, scene, profile)) {
+        printf("Tuning profile: none for scene %s on this host in %s, using the defaults\n",
+               scene.c_str(), filename.c_str());
+        return;
+    }
+
+    char threads[32] = "threads from -t";
+    renderer->setTileSize(profile.tileSize);
+    if (!threadsGiven) {
+        renderer->setNumThreads(profile.numThreads);
+        sprintf(threads, "%d threads", profile.numThreads);
+    }
+    printf("Tuning profile: %dx%d tiles, %s (scene %s, %.2f ms/frame when tuned, from %s)\n",
+           profile.tileSize, profile.tileSize, threads, scene.c_str(), profile.msPerFrame, filename.c_str());
+}
+
+// timeConfiguration --
+//
+// Best frame time (clear and render) in ms of the tiled renderer with
+// the given tile size and thread count, after one warm-up frame, or -1
+// if the image could not be allocated.
+static double
+timeConfiguration(int numCircles, const float* position, const float* color, const float* radius,
+                  int imageSize, int tileSize, int numThreads, int numFrames, bool antialias, bool compact) {
+
+    TiledRenderer renderer;
+    renderer.setTileSize(tileSize);
+    renderer.setNumThreads(numThreads);
+    renderer.setAntialias(antialias);
+    renderer.setCompactScene(compact);
+    if (!renderer.allocOutputImage(imageSize, imageSize))
+        return -1.0;
+    renderer.setSceneColumns(numCircles, position, color, radius);
+    renderer.setup();
+
+    renderer.clearImage();
+    renderer.render();
+
+    double best = 0.0;
+    for (int frame=0; frame<numFrames; frame++) {
+        double startTime = CycleTimer::currentSeconds();
+        renderer.clearImage();
+        renderer.render();
+        double frameTime = CycleTimer::currentSeconds() - startTime;
+        if (frame == 0 || frameTime < best)
+            best = frameTime;
+    }
+    return 1000.0 * best;
+}
+
+void
+startAutotune(SceneName sceneName, const std::string& sceneNameStr, int imageSize, int numFrames,
+              const std::string& filename, bool antialias, bool compact) {
+
+    int numCircles;
+    float* position;
+    float* color;
+    float* radius;
+    loadCircleScene(sceneName, numCircles, position, color, radius);
+
+    // thread counts: powers of two up to the worker thread count (all
+    // hardware threads, or -t), which is always tried
+    int maxThreads = numWorkerThreads();
+    std::vector<int> threadCounts;
+    for (int threads=1; threads<maxThreads; threads*=2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    TuningProfile best;
+    best.host = tuningHostKey();
+    best.scene = tuningSceneSignature(numCircles, radius, imageSize, imageSize, antialias, compact);
+    best.tileSize = DEFAULT_TILE_SIZE;
+    best.numThreads = maxThreads;
+    best.msPerFrame = 0.0;
+    double defaultTime = 0.0;
+
+    printf("Autotuning %s (%d circles), %d frames per configuration\n", sceneNameStr.c_str(), numCircles, numFrames);
+    printf("Host:  %s\n", best.host.c_str());
+    printf("Scene: %s\n", best.scene.c_str());
+    printf("  tile  threads   ms/frame\n");
+
+    bool first = true;
+    for (size_t t=0; t<sizeof(tuningTileSizes) / sizeof(tuningTileSizes[0]); t++) {
+        for (size_t c=0; c<threadCounts.size(); c++) {
+
+            int tileSize = tuningTileSizes[t];
+            double ms = timeConfiguration(numCircles, position, color, radius, imageSize,
+                                          tileSize, threadCounts[c], numFrames, antialias, compact);
+            if (ms < 0.0) {
+                fprintf(stderr, "Error: could not allocate a %dx%d framebuffer\n", imageSize, imageSize);
+                delete [] position;
+                delete [] color;
+                delete [] radius;
+                return;
+            }
+            printf("  %4d  %7d  %9.3f\n", tileSize, threadCounts[c], ms);
+            fflush(stdout);
+
+            if (tileSize == DEFAULT_TILE_SIZE && threadCounts[c] == maxThreads)
+                defaultTime = ms;
+            if (first || ms < best.msPerFrame) {
+                best.tileSize = tileSize;
+                best.numThreads = threadCounts[c];
+                best.msPerFrame = ms;
+                first = false;
+            }
+        }
+    }
+
+    delete [] position;
+    delete [] color;
+    delete [] radius;
+
+    printf("Best: %dx%d tiles, %d threads, %.3f ms/frame (defaults %dx%d, %d threads: %.3f ms/frame, %.2fx)\n",
+           best.tileSize, best.tileSize, best.numThreads, best.msPerFrame,
+           DEFAULT_TILE_SIZE, DEFAULT_TILE_SIZE, maxThreads, defaultTime,
+           best.msPerFrame > 0.0 ? defaultTime / best.msPerFrame : 1.0);
+
+    if (saveTuningProfile(filename, best))
+        printf("Saved the profile to %s\n", filename.c_str());
+}
@@ -0,0 +1,78 @@
+#ifndef __AUTOTUNE_H__
+#define __AUTOTUNE_H__
+
+#include <string>
+
+#include "circleRenderer.h"
+
+class TiledRenderer;
+
+// Tile size and thread count of the tiled renderer, tuned per host and
+// per kind of scene.
+//
+// --autotune renders a scene with every combination of a grid of tile
+// sizes and thread counts and saves the fastest one as a profile in a
+// tuning file (render.tuning by default), one line per profile:
+//
+//   host <TAB> scene signature <TAB> tile size <TAB> threads <TAB> ms per frame
+//
+// The host is the CPU model and its number of hardware threads.  The
+// scene signature is coarse on purpose (powers of two of the circle
+// count, of the median radius in pixels and of the average number of
+// circles covering a pixel, plus the resolution and the shading mode),
+// so that similar scenes share a profile.  Later runs of the tiled
+// renderer look up the profile of their host and scene in the same file.
+
+#define DEFAULT_TUNING_FILE "render.tuning"
+
+// frames timed for every configuration, after one warm-up frame
+#define AUTOTUNE_DEFAULT_FRAMES 3
+
+struct TuningProfile {
+    std::string host;
+    std::string scene;
+    int tileSize;
+    int numThreads;
+    double msPerFrame;
+};
+
+// tuningHostKey --
+//
+// CPU model name and hardware thread count of this host.
+std::string tuningHostKey();
+
+// tuningSceneSignature --
+//
+// Coarse signature of a scene (radius normalized to the image width)
+// rendered at the given resolution.
+std::string tuningSceneSignature(int numCircles, const float* radius, int width, int height,
+                                 bool antialias, bool compact);
+
+// findTuningProfile --
+//
+// Profile of the given host and scene in the tuning file.  Returns
+// false if there is none, or no such file.
+bool findTuningProfile(const std::string& filename, const std::string& host, const std::string& scene,
+                       TuningProfile& profile);
+
+// saveTuningProfile --
+//
+// Adds the profile to the tuning file, replacing the one of the same
+// host and scene.
+bool saveTuningProfile(const std::string& filename, const TuningProfile& profile);
+
+// applyTuningProfile --
+//
+// Sets the tile size and (unless threadsGiven, -t) the thread count of
+// the renderer from its profile, before setup().  The scene must be
+// loaded.  Prints the profile used, if the tuning file exists.
+void applyTuningProfile(TiledRenderer* renderer, const std::string& filename, bool threadsGiven);
+
+// startAutotune --
+//
+// Times the tiled renderer on the scene for every tile size and thread
+// count of the grid, and saves the fastest combination.
+void startAutotune(SceneName sceneName, const std::string& sceneNameStr, int imageSize, int numFrames,
+                   const std::string& filename, bool antialias, bool compact);
+
+#endif
@@ -1,10 +1,18 @@
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <math.h>
 
 #include "circleRenderer.h"
 #include "cycleTimer.h"
+#include "framebuffer.h"
 #include "image.h"
+#include "perfCounters.h"
+#include "planner.h"
 #include "ppm.h"
+#include "simulation.h"
+#include "tileSequence.h"
+#include "trace.h"
 
 static void compare_images(const Image* ref_image, const Image* cuda_image) {
     int i;
@@ -18,9 +26,22 @@ static void compare_images(const Image* ref_image, const Image* cuda_image) {
         exit (1);
     }
     
+    // either image may be stored tile by tile, compare them in row order
+    int rowFloats = 4 * ref_image->width;
+    std::vector<float> refRow(rowFloats);
+    std::vector<float> cudaRow(rowFloats);
+    const float* refPixels = NULL;
+    const float* cudaPixels = NULL;
+
     for (i = 0 ; i < 4 * ref_image->width * ref_image->height; i++) {
+        if (i % rowFloats == 0) {
+            int y = i / rowFloats;
+            refPixels = ref_image->rowPixels(y, 0, ref_image->width, &refRow[0]);
+            cudaPixels = cuda_image->rowPixels(y, 0, cuda_image->width, &cudaRow[0]);
+        }
+
         // Compare with floating point error tolerance of 0.1f and ignore alpha
-        if (fabs(ref_image->data[i] - cuda_image->data[i]) > 0.1f && i%4 != 3) {
+        if (fabs(refPixels[i % rowFloats] - cudaPixels[i % rowFloats]) > 0.1f && i%4 != 3) {
             mismatch_count++;
 
             //Uncomment this section to see what are the errors found comparing pixels
@@ -51,12 +72,56 @@ static void compare_images(const Image* ref_image, const Image* cuda_image) {
 }
 
 
+// benchmark phases measured with hardware counters
+enum {
+    PHASE_CLEAR,
+    PHASE_RENDER,
+    PHASE_FILE_IO,
+    NUM_PHASES
+};
+
+static const char* phaseNames[NUM_PHASES] = { "Clear", "Render", "File IO" };
+
+// printPhaseCounters --
+//
+// IPC and miss rates of a benchmark phase, from the events it counted
+// (negative when a counter is unavailable).  Misses are given per
+// pixel, and per circle when circles is not 0.
+static void
+printPhaseCounters(const char* phase, const double* events, double pixels, double circles) {
+
+    printf("  %-8s", phase);
+
+    if (events[PERF_CYCLES] > 0.0 && events[PERF_INSTRUCTIONS] >= 0.0)
+        printf(" IPC %5.2f", events[PERF_INSTRUCTIONS] / events[PERF_CYCLES]);
+    else
+        printf(" IPC   n/a");
+
+    const PerfCounter misses[] = { PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES };
+    for (int i=0; i<3; i++) {
+        double count = events[misses[i]];
+        printf(" | %s", PerfCounters::counterName(misses[i]));
+        if (count < 0.0) {
+            printf(" n/a");
+            continue;
+        }
+        printf(" %.4f/pixel", count / pixels);
+        if (circles > 0.0)
+            printf(" %.2f/circle", count / circles);
+    }
+    printf("\n");
+}
+
 //This function returns the time needed for the rendering of a specified number of frames. The time for
 //each frame is returned.
 //To invoke this method is necessary to call the executable with the option -b <number of frames>. By default
 //Also it is necessary to specify if the frames need to be handled by cpu or gpu using -r ref (defualt) or
 //-r cuda.
 //Finally with the option -f <filename> is specified the name of the frame(s). By default is "image".
+//With -R x0,y0,x1,y1 only the pixels in [x0,x1) x [y0,y1) are rendered (region is NULL otherwise).
+//With -P the hardware counters of the process are read around every phase (numCircles is the size
+//of the scene, to report misses per circle).
+//With --explain the render time is compared with the one predicted by the plan (NULL otherwise).
 //
 //First example: ./render -b 3 -f my_file -r cuda rand10k   save 3 frames of rand10k by the name my_file,
 //															created with cuda
@@ -67,46 +132,154 @@ startBenchmark(
     CircleRenderer* renderer,
     const std::string& rendererType,
     int totalFrames,
-    const std::string& frameFilename)
+    const std::string& frameFilename,
+    ImageFormat format,
+    const int* region,
+    bool perfCounters,
+    int numCircles,
+    SimulationPipeline* simulation,
+    const RenderPlan* plan)
 {
 
     double totalTime = 0.f;
     double startTime= 0.f;
+    double totalFileSaveTime = 0.f;
+    double totalRenderTime = 0.f;
+    double bestRenderTime = 0.f;
+    double totalStepTime = 0.f;
+    double totalWaitTime = 0.f;
+    size_t totalBytesWritten = 0;
+    const char* extension = imageFormatExtension(format);
 
     printf("\nRunning benchmark, %d frames...\n", totalFrames);
 
-    printf("Dumping frames to %s_frameXXX_%s.ppm\n", frameFilename.c_str(), rendererType.c_str());
+    // with -F tseq all frames go to one tile-delta sequence, using the
+    // renderer's tile hashes if it computes them
+    TileSequenceWriter sequence;
+    bool rendererHashes = false;
+    if (format == IMAGE_FORMAT_TILE_SEQUENCE) {
+        char filename[1024];
+        sprintf(filename, "%s_%s.%s", frameFilename.c_str(), rendererType.c_str(), extension);
+        const Image* image = renderer->getImage();
+        if (!sequence.open(filename, image->width, image->height, TILE_SEQUENCE_TILE_SIZE))
+            exit(1);
+        rendererHashes = renderer->enableTileHashes(TILE_SEQUENCE_TILE_SIZE);
+        printf("Writing frames to the tile sequence %s (tile hashes computed by the %s)\n",
+               filename, rendererHashes ? "renderer" : "writer");
+    } else {
+        printf("Dumping frames to %s_frameXXX_%s.%s\n", frameFilename.c_str(), rendererType.c_str(), extension);
+    }
+
+    if (region)
+        printf("Rendering region [%d, %d) x [%d, %d)\n", region[0], region[2], region[1], region[3]);
+    if (simulation)
+        printf("Simulating the circles on %d threads, pipelined with rendering\n", simulation->numThreads());
+
+    // the counters follow all the threads of the process, the worker
+    // threads already exist at this point
+    PerfCounters counters;
+    bool countEvents = perfCounters && counters.open() > 0;
+    PerfSample samples[NUM_PHASES + 1];
+    double phaseEvents[NUM_PHASES][PERF_NUM_COUNTERS];
+    double totalEvents[NUM_PHASES][PERF_NUM_COUNTERS] = {};
+
+    const Image* outputImage = renderer->getImage();
+    double numPixels = region ? static_cast<double>(region[2] - region[0]) * (region[3] - region[1])
+                              : static_cast<double>(outputImage->width) * outputImage->height;
 
     for (int frame=0; frame<totalFrames; frame++) {
 
+        TRACE_ZONE_ARG("frame", "frame", frame);
+
         if (frame == 0)
             startTime = CycleTimer::currentSeconds();
 
+        // the front buffer of the simulation is the scene of this frame
+        if (simulation)
+            renderer->setSceneColumns(simulation->numCircles(), simulation->position(),
+                                      simulation->color(), simulation->radius());
+
+        if (countEvents)
+            counters.read(samples[PHASE_CLEAR]);
+
         double startClearTime = CycleTimer::currentSeconds();
 
         renderer->clearImage();
 
         double endClearTime = CycleTimer::currentSeconds();
 
-        renderer->render();
+        if (countEvents)
+            counters.read(samples[PHASE_RENDER]);
+
+        if (region)
+            renderer->renderRegion(region[0], region[1], region[2], region[3]);
+        else
+            renderer->render();
 
         double endRenderTime = CycleTimer::currentSeconds();
 
+        // the next step runs while this frame is written, and while
+        // the next one renders
+        if (simulation) {
+            simulation->swap();
+            totalStepTime += simulation->lastStepTime();
+            totalWaitTime += simulation->lastWaitTime();
+        }
+
+        if (countEvents)
+            counters.read(samples[PHASE_FILE_IO]);
+
         //saving the frame file
-        char filename[1024];
-        sprintf(filename, "%s_frame%d_%s.ppm", frameFilename.c_str(),frame,rendererType.c_str());
-        writePPMImage(renderer->getImage(), filename);
+        const Image* image = renderer->getImage();
+        size_t bytesWritten;
+        if (format == IMAGE_FORMAT_TILE_SEQUENCE) {
+            bytesWritten = sequence.writeFrame(image, rendererHashes ? renderer->getTileHashes() : NULL);
+            printf("Tile sequence: %d of %d tiles changed\n", sequence.lastChangedTiles(), sequence.tileCount());
+        } else {
+            char filename[1024];
+            sprintf(filename, "%s_frame%d_%s.%s", frameFilename.c_str(),frame,rendererType.c_str(), extension);
+            bytesWritten = writeImage(image, filename, format);
+        }
 
         double endFileSaveTime = CycleTimer::currentSeconds();
 
+        if (countEvents)
+            counters.read(samples[NUM_PHASES]);
+
         double clearTime = endClearTime - startClearTime;
         double renderTime = endRenderTime-endClearTime;
         double fileSaveTime = endFileSaveTime - endRenderTime;
+        totalRenderTime += renderTime;
+        bestRenderTime = frame == 0 ? renderTime : std::min(bestRenderTime, renderTime);
+
+        // encode throughput is measured on the 24-bit pixel data that
+        // is being encoded, independently of the size of the output
+        double rawMB = 3.0 * image->width * image->height / (1024 * 1024);
+        totalFileSaveTime += fileSaveTime;
+        totalBytesWritten += bytesWritten;
 
         printf("Clear:    %.4f ms\n", 1000.f * clearTime);
 		printf("Render:   %.4f ms\n", 1000.f * renderTime);
 		printf("Total:    %.4f ms\n", 1000.f * (clearTime + renderTime));
-		printf("File IO:  %.4f ms\n", 1000.f * fileSaveTime);
+		printf("File IO:  %.4f ms (%.1f KB written, %.1f MB/s)\n", 1000.f * fileSaveTime,
+		       bytesWritten / 1024.0, rawMB / fileSaveTime);
+        if (simulation)
+            printf("Simulate: %.4f ms (overlapped), %.4f ms waited for it\n",
+                   1000.f * simulation->lastStepTime(), 1000.f * simulation->lastWaitTime());
+        if (countEvents) {
+            printf("Counters:\n");
+            for (int phase=0; phase<NUM_PHASES; phase++) {
+                for (int counter=0; counter<PERF_NUM_COUNTERS; counter++) {
+                    double events = counters.delta(samples[phase], samples[phase+1], static_cast<PerfCounter>(counter));
+                    phaseEvents[phase][counter] = events;
+                    totalEvents[phase][counter] = events < 0.0 || totalEvents[phase][counter] < 0.0 ? -1.0
+                                                  : totalEvents[phase][counter] + events;
+                }
+                printPhaseCounters(phaseNames[phase], phaseEvents[phase], numPixels,
+                                   phase == PHASE_RENDER ? numCircles : 0);
+            }
+        }
+		renderer->printRenderStats();
 		printf("\n");
 
     }
@@ -116,12 +289,30 @@ startBenchmark(
 
     printf("\n");
     printf("Overall:  %.4f sec (note units are seconds)\n", totalTime);
+    if (totalFrames > 0)
+        printf("File IO:  %.4f ms/frame, %.1f KB/frame\n",
+               1000.f * totalFileSaveTime / totalFrames, totalBytesWritten / 1024.0 / totalFrames);
+    if (simulation && totalFrames > 0)
+        printf("Simulate: %.4f ms/step, %.4f ms/frame waited for it\n",
+               1000.f * totalStepTime / totalFrames, 1000.f * totalWaitTime / totalFrames);
+    if (plan && totalFrames > 0)
+        printf("Plan:     %.4f ms/frame predicted, %.4f ms/frame measured (%.4f ms best frame)\n",
+               plan->predictedMs[plan->strategy], 1000.f * totalRenderTime / totalFrames, 1000.f * bestRenderTime);
+    if (countEvents && totalFrames > 0) {
+        printf("Counters (all frames):\n");
+        for (int phase=0; phase<NUM_PHASES; phase++)
+            printPhaseCounters(phaseNames[phase], totalEvents[phase], numPixels * totalFrames,
+                               phase == PHASE_RENDER ? static_cast<double>(numCircles) * totalFrames : 0);
+    }
+    printf("Peak framebuffer memory: %.2f MB\n",
+           static_cast<double>(FramebufferPool::instance().peakMappedBytes()) / (1024 * 1024));
 
 }
 
 //CheckBenchmark executes 10 frames both for cpu and gpu, and returns the rendering average time for both,
 //allowing us to compare them.
-//It is invokable executing the runnable with option -c.
+//It is invokable executing the runnable with option -c. With -c -r tiled the multithreaded CPU renderer
+//is checked instead of the CUDA one (rendererType names it in the output).
 //
 //Example: ./render -c rand100k executes 10 frames of rand100k with cpu and cuda both and print the average
 //								results
@@ -129,6 +320,7 @@ void
 CheckBenchmark(
     CircleRenderer* ref_renderer,
     CircleRenderer* cuda_renderer,
+    const std::string& rendererType,
     const std::string& frameFilename)
 {
 
@@ -141,7 +333,7 @@ CheckBenchmark(
 
     printf("\nRunning benchmark with 10 frames, the result is an average of the results\n");
 
-    printf("Dumping frames to %s_cpu.ppm and %s_cuda\n", frameFilename.c_str(), frameFilename.c_str());
+    printf("Dumping frames to %s_cpu.ppm and %s_%s.ppm\n", frameFilename.c_str(), frameFilename.c_str(), rendererType.c_str());
 
     //first we compute the average time needed for the rendering of 10 frames with the CPU
 
@@ -195,7 +387,7 @@ CheckBenchmark(
 			double startFileSaveTime = CycleTimer::currentSeconds();
 
 			char filename[1024];
-			sprintf(filename, "%s_cuda.ppm", frameFilename.c_str());
+			sprintf(filename, "%s_%s.ppm", frameFilename.c_str(), rendererType.c_str());
 			writePPMImage(cuda_renderer->getImage(), filename);
 
 			double endFileSaveTime = CycleTimer::currentSeconds();
@@ -221,7 +413,7 @@ CheckBenchmark(
 
 	printf("\n*********************************************************************\n\n");
 
-	printf("CUDA time:\n");
+	printf("%s time:\n", rendererType.c_str());
 	printf("Clear:    %.4f ms\n", 1000.f * totalCudaClearTime);
 	printf("Render:   %.4f ms\n", 1000.f * totalCudaRenderTime);
 	printf("Total:    %.4f ms\n", 1000.f * (totalCudaClearTime + totalCudaRenderTime));
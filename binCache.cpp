@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include "binCache.h"
+#include "counterRng.h"
+
+static const char binCacheMagic[4] = { 'T', 'B', 'I', 'N' };
+
+
+// hashWords --
+//
+// Order dependent hash of count 32-bit words, two at a time.
+static uint64_t
+hashWords(uint64_t h, const float* values, size_t count) {
+
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(values);
+    size_t i = 0;
+    for (; i+1<count; i+=2)
+        h = splitMix64(h ^ (static_cast<uint64_t>(words[i]) << 32 | words[i+1]));
+    if (i < count)
+        h = splitMix64(h ^ words[i]);
+    return h;
+}
+
+bool
+BinCacheKey::operator==(const BinCacheKey& other) const {
+    return sceneHash == other.sceneHash && numCircles == other.numCircles &&
+           width == other.width && height == other.height && tileSize == other.tileSize &&
+           regionMinX == other.regionMinX && regionMinY == other.regionMinY &&
+           regionMaxX == other.regionMaxX && regionMaxY == other.regionMaxY &&
+           flags == other.flags && reserved == other.reserved;
+}
+
+uint64_t
+hashSceneGeometry(int numCircles, const float* position, const float* radius) {
+
+    uint64_t h = splitMix64(static_cast<uint64_t>(numCircles));
+    h = hashWords(h, position, 3 * static_cast<size_t>(numCircles));
+    return hashWords(h, radius, numCircles);
+}
+
+std::string
+binCacheFilename(const std::string& directory, const BinCacheKey& key) {
+
+    // the key has no padding, every byte of it is a field
+    uint64_t h = key.sceneHash;
+    const int32_t* fields = &key.numCircles;
+    for (int i=0; i<10; i++)
+        h = splitMix64(h ^ static_cast<uint32_t>(fields[i]));
+
+    char name[64];
+    sprintf(name, "bins-%016llx.tbin", static_cast<unsigned long long>(h));
+    return directory + "/" + name;
+}
+
+
+BinCacheFile::BinCacheFile() {
+    header = NULL;
+    tileStart = NULL;
+    tileCost = NULL;
+    tileCircles = NULL;
+    mapping = NULL;
+    mappedBytes = 0;
+}
+
+BinCacheFile::~BinCacheFile() {
+    close();
+}
+
+bool
+BinCacheFile::open(const std::string& filename, const BinCacheKey& key) {
+
+    close();
+
+    const char* data = NULL;
+    size_t numBytes = 0;
+
+#if defined(__linux__)
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(BinCacheHeader)) {
+        ::close(fd);
+        return false;
+    }
+    numBytes = static_cast<size_t>(info.st_size);
+    void* ptr = mmap(NULL, numBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+    mapping = ptr;
+    mappedBytes = numBytes;
+    data = static_cast<const char*>(ptr);
+#else
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (!fp)
+        return false;
+    char buffer[1 << 16];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        contents.insert(contents.end(), buffer, buffer + count);
+    fclose(fp);
+    numBytes = contents.size();
+    data = contents.empty() ? NULL : &contents[0];
+    if (numBytes < sizeof(BinCacheHeader)) {
+        close();
+        return false;
+    }
+#endif
+
+    const BinCacheHeader* fileHeader = reinterpret_cast<const BinCacheHeader*>(data);
+    bool valid = memcmp(fileHeader->magic, binCacheMagic, sizeof(binCacheMagic)) == 0 &&
+                 fileHeader->version == BIN_CACHE_VERSION && fileHeader->key == key &&
+                 fileHeader->numTiles >= 0 && fileHeader->numEntries >= 0;
+    size_t expectedBytes = valid ? sizeof(BinCacheHeader) +
+                                   sizeof(int) * (static_cast<size_t>(fileHeader->numTiles) + 1) +
+                                   sizeof(float) * fileHeader->numTiles +
+                                   sizeof(int) * static_cast<size_t>(fileHeader->numEntries) : 0;
+    if (!valid || numBytes != expectedBytes) {
+        close();
+        return false;
+    }
+
+    header = fileHeader;
+    tileStart = reinterpret_cast<const int*>(data + sizeof(BinCacheHeader));
+    tileCost = reinterpret_cast<const float*>(tileStart + header->numTiles + 1);
+    tileCircles = reinterpret_cast<const int*>(tileCost + header->numTiles);
+    return true;
+}
+
+void
+BinCacheFile::close() {
+
+#if defined(__linux__)
+    if (mapping)
+        munmap(mapping, mappedBytes);
+#endif
+    mapping = NULL;
+    mappedBytes = 0;
+    contents.clear();
+    header = NULL;
+    tileStart = NULL;
+    tileCost = NULL;
+    tileCircles = NULL;
+}
+
+bool
+BinCacheFile::write(const std::string& filename, const BinCacheKey& key, int numTiles,
+                    const int* tileStart, const float* tileCost, const int* tileCircles,
+                    int subPixelCircles, int culledCircles) {
+
+    size_t slash = filename.rfind('/');
+    if (slash != std::string::npos && slash > 0)
+        mkdir(filename.substr(0, slash).c_str(), 0777);
+
+    BinCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, binCacheMagic, sizeof(binCacheMagic));
+    header.version = BIN_CACHE_VERSION;
+    header.key = key;
+    header.numTiles = numTiles;
+    header.numEntries = tileStart[numTiles];
+    header.subPixelCircles = subPixelCircles;
+    header.culledCircles = culledCircles;
+
+    char suffix[32];
+    sprintf(suffix, ".tmp%d", static_cast<int>(getpid()));
+    std::string tempname = filename + suffix;
+
+    FILE* fp = fopen(tempname.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(tileStart, sizeof(int), numTiles + 1, fp) == static_cast<size_t>(numTiles + 1) &&
+              fwrite(tileCost, sizeof(float), numTiles, fp) == static_cast<size_t>(numTiles) &&
+              fwrite(tileCircles, sizeof(int), header.numEntries, fp) == static_cast<size_t>(header.numEntries);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tempname.c_str(), filename.c_str()) != 0) {
+        remove(tempname.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef __BIN_CACHE_H__
+#define __BIN_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// On-disk cache of the tiled renderer's tile lists (--bin-cache DIR).
+//
+// Binning a large static scene costs the same in every frame and in
+// every process.  With a cache directory, the tile lists built for a
+// frame are saved in a file named after a hash of everything they
+// depend on (BinCacheKey), and later runs map that file instead of
+// binning again.  A change of the scene, resolution, tile size, region
+// or shading mode changes the key, hence the file; the full key is also
+// stored in the file and checked when it is opened.
+//
+// File layout, in host byte order (the cache is not meant to be moved
+// between machines):
+//
+//   BinCacheHeader
+//   tile start     numTiles + 1 x int32   (CSR offsets, see TiledRenderer)
+//   tile cost      numTiles x float
+//   tile circles   numEntries x int32     (with SUBPIXEL_CIRCLE_FLAG)
+
+#define BIN_CACHE_VERSION 1
+
+// BinCacheKey flags
+#define BIN_CACHE_ANTIALIAS 0x1
+#define BIN_CACHE_COMPACT   0x2
+
+struct BinCacheKey {
+    // hash of the circle positions and radii (hashSceneGeometry)
+    uint64_t sceneHash;
+    int32_t numCircles;
+    int32_t width;
+    int32_t height;
+    int32_t tileSize;
+    int32_t regionMinX;
+    int32_t regionMinY;
+    int32_t regionMaxX;
+    int32_t regionMaxY;
+    int32_t flags;
+    int32_t reserved;
+
+    bool operator==(const BinCacheKey& other) const;
+};
+
+struct BinCacheHeader {
+    char magic[4];
+    uint32_t version;
+    BinCacheKey key;
+    int32_t numTiles;
+    int32_t numEntries;
+    // circle counts reported by the binning pass
+    int32_t subPixelCircles;
+    int32_t culledCircles;
+};
+
+// hashSceneGeometry --
+//
+// Hash of the geometry of a scene, the part of it binning depends on.
+uint64_t hashSceneGeometry(int numCircles, const float* position, const float* radius);
+
+// binCacheFilename --
+//
+// Cache file of the given key in the directory.
+std::string binCacheFilename(const std::string& directory, const BinCacheKey& key);
+
+
+// BinCacheFile --
+//
+// Tile lists read from a cache file.  On Linux the file is mapped
+// read-only, so the lists are paged in on demand and shared with other
+// processes using the same cache; elsewhere it is read into memory.
+class BinCacheFile {
+
+public:
+
+    BinCacheFile();
+    ~BinCacheFile();
+
+    // open --
+    //
+    // Maps the file if it exists and holds the tile lists of the key.
+    // Returns false if it does not (the file is then left alone, it is
+    // replaced by the next write).
+    bool open(const std::string& filename, const BinCacheKey& key);
+
+    void close();
+
+    // write --
+    //
+    // Saves the tile lists, through a temporary file renamed in place,
+    // so that concurrent readers never see a partial file.  The
+    // directory is created if needed.  Returns false if the file could
+    // not be written.
+    static bool write(const std::string& filename, const BinCacheKey& key, int numTiles,
+                      const int* tileStart, const float* tileCost, const int* tileCircles,
+                      int subPixelCircles, int culledCircles);
+
+    const BinCacheHeader* header;
+    const int* tileStart;
+    const float* tileCost;
+    const int* tileCircles;
+
+private:
+
+    void* mapping;
+    size_t mappedBytes;
+    // file contents where mmap is not used
+    std::vector<char> contents;
+
+    BinCacheFile(const BinCacheFile&);
+    BinCacheFile& operator=(const BinCacheFile&);
+};
+
+
+#endif
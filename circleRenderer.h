@@ -1,6 +1,9 @@
 #ifndef __CIRCLE_RENDERER_H__
 #define __CIRCLE_RENDERER_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct Image;
 
 
@@ -25,12 +28,62 @@ public:
 
     virtual void loadScene(SceneName name) = 0;
 
-    virtual void allocOutputImage(int width, int height) = 0;
+    // returns false if the image could not be allocated; the renderer
+    // then has no image until a later allocation succeeds
+    virtual bool allocOutputImage(int width, int height) = 0;
+
+    // render the next frames at a lower resolution (at most the size
+    // given to allocOutputImage), see Image::resize.  Returns false,
+    // and keeps the resolution, if the size exceeds the image
+    virtual bool setRenderResolution(int width, int height) = 0;
 
     virtual void clearImage() = 0;
 
+    // clear only the pixels in [minX, maxX) x [minY, maxY), ahead of a
+    // renderRegion of the same rectangle.  Renderers that cannot clear
+    // part of their image clear all of it
+    virtual void clearRegion(int minX, int minY, int maxX, int maxY) { clearImage(); }
+
     virtual void render() = 0;
 
+    // render only the pixels in [minX, maxX) x [minY, maxY).  Pixels
+    // outside the rectangle are left untouched, pixels inside are
+    // identical to the same pixels of a full render()
+    virtual void renderRegion(int minX, int minY, int maxX, int maxY) = 0;
+
+    // print renderer specific statistics about the last frame
+    virtual void printRenderStats() {}
+
+    // print the configuration of the renderer and what it made of the
+    // loaded scene, after setup().  Renderers print nothing by
+    // themselves otherwise
+    virtual void printSetupInfo() {}
+
+    // render circles owned by the caller instead of a built-in scene,
+    // in the layout of loadCircleScene (x, y, z and r, g, b per circle,
+    // radius).  The arrays are not copied and must stay valid and
+    // unchanged until the next scene is set or the renderer is deleted.
+    // Returns false if the renderer does not support it
+    virtual bool setSceneColumns(int numCircles, const float* position, const float* color, const float* radius) { return false; }
+
+    // render into width x height RGBA float pixels owned by the caller
+    // (bottom row first, no padding) instead of an image of the
+    // renderer's own.  Returns false if the renderer does not support it
+    virtual bool setOutputBuffer(float* data, int width, int height) { return false; }
+
+    // shade with the fractional coverage of every pixel instead of
+    // sampling pixel centers.  Returns false if the renderer does not
+    // support it
+    virtual bool setAntialias(bool enable) { return !enable; }
+
+    // compute a hash of every tileSize x tileSize tile of the image
+    // while rendering (see tileSequence.h).  Returns false if the
+    // renderer does not support it, or not for this tile size
+    virtual bool enableTileHashes(int tileSize) { return false; }
+
+    // tile hashes of the last frame, or NULL
+    virtual const uint64_t* getTileHashes() { return NULL; }
+
     //virtual void dumpParticles(const char* filename) {}
 
 };
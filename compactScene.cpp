@@ -0,0 +1,172 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "compactScene.h"
+#include "parallel.h"
+
+#define PARALLEL_ENCODE_CHUNK 16384
+
+// Quantizer --
+//
+// Fixed point mapping of [minValue, maxValue] onto [0, maxCode].
+struct Quantizer {
+    float origin;
+    float scale;
+    int maxCode;
+
+    Quantizer(float minValue, float maxValue, int codes) {
+        origin = minValue;
+        maxCode = codes;
+        scale = maxValue > minValue ? (maxValue - minValue) / maxCode : 0.f;
+    }
+
+    int encode(float value) const {
+        if (scale == 0.f)
+            return 0;
+        long code = lroundf((value - origin) / scale);
+        return static_cast<int>(std::min(std::max(code, 0L), static_cast<long>(maxCode)));
+    }
+
+    float decode(int code) const {
+        return origin + code * scale;
+    }
+
+    // half a step, plus the rounding of the float decode
+    float bound() const {
+        float magnitude = std::max(fabsf(origin), fabsf(decode(maxCode)));
+        return .5f * scale + 4.f * FLT_EPSILON * magnitude;
+    }
+};
+
+// buildPalette --
+//
+// Palette of the distinct colors of the scene, in order of first use.
+// Returns false if there are more than COMPACT_PALETTE_SIZE of them.
+static bool
+buildPalette(int numCircles, const float* color, CompactScene& scene) {
+
+    typedef std::pair<uint64_t, uint32_t> ColorKey;
+    std::map<ColorKey, int> entries;
+
+    scene.colorIndex.resize(numCircles);
+
+    for (int i=0; i<numCircles; i++) {
+        uint32_t bits[3];
+        memcpy(bits, &color[3*i], sizeof(bits));
+        ColorKey key(static_cast<uint64_t>(bits[0]) << 32 | bits[1], bits[2]);
+
+        std::map<ColorKey, int>::iterator it = entries.find(key);
+        if (it == entries.end()) {
+            if (entries.size() == COMPACT_PALETTE_SIZE) {
+                scene.colorIndex.clear();
+                scene.palette.clear();
+                return false;
+            }
+            it = entries.insert(std::make_pair(key, static_cast<int>(entries.size()))).first;
+            scene.palette.insert(scene.palette.end(), &color[3*i], &color[3*i+3]);
+        }
+        scene.colorIndex[i] = static_cast<uint8_t>(it->second);
+    }
+    return true;
+}
+
+bool
+buildCompactScene(
+    int numCircles,
+    const float* position,
+    const float* color,
+    const float* radius,
+    CompactScene& scene)
+{
+    scene.numCircles = numCircles;
+    scene.circles.resize(numCircles);
+    scene.palette.clear();
+    scene.colorIndex.clear();
+    scene.colorRGB.clear();
+
+    float minX = FLT_MAX, maxX = -FLT_MAX;
+    float minY = FLT_MAX, maxY = -FLT_MAX;
+    float maxRadius = 0.f;
+    float minColor = FLT_MAX, maxColor = -FLT_MAX;
+
+    for (int i=0; i<numCircles; i++) {
+        minX = std::min(minX, position[3*i]);
+        maxX = std::max(maxX, position[3*i]);
+        minY = std::min(minY, position[3*i+1]);
+        maxY = std::max(maxY, position[3*i+1]);
+        maxRadius = std::max(maxRadius, radius[i]);
+        for (int c=0; c<3; c++) {
+            minColor = std::min(minColor, color[3*i+c]);
+            maxColor = std::max(maxColor, color[3*i+c]);
+        }
+    }
+    if (numCircles == 0)
+        minX = maxX = minY = maxY = minColor = maxColor = 0.f;
+
+    // radii are quantized from 0, so that no circle can vanish or grow
+    // by more than half a step
+    Quantizer quantX(minX, maxX, 0xffff);
+    Quantizer quantY(minY, maxY, 0xffff);
+    Quantizer quantRadius(0.f, maxRadius, 0xffff);
+    Quantizer quantColor(minColor, maxColor, 0xff);
+
+    scene.originX = quantX.origin;
+    scene.scaleX = quantX.scale;
+    scene.originY = quantY.origin;
+    scene.scaleY = quantY.scale;
+    scene.radiusScale = quantRadius.scale;
+    scene.colorOrigin = quantColor.origin;
+    scene.colorScale = quantColor.scale;
+
+    bool palette = buildPalette(numCircles, color, scene);
+    if (!palette)
+        scene.colorRGB.resize(3 * numCircles);
+
+    scene.positionError = scene.radiusError = scene.colorError = 0.f;
+    scene.positionBound = std::max(quantX.bound(), quantY.bound());
+    scene.radiusBound = quantRadius.bound();
+    scene.colorBound = palette ? 0.f : quantColor.bound();
+
+    std::mutex errorLock;
+
+    parallelFor(0, numCircles, PARALLEL_ENCODE_CHUNK, [&](int begin, int end) {
+
+        float positionError = 0.f, radiusError = 0.f, colorError = 0.f;
+
+        for (int i=begin; i<end; i++) {
+            CompactCircle& circle = scene.circles[i];
+            circle.x = static_cast<uint16_t>(quantX.encode(position[3*i]));
+            circle.y = static_cast<uint16_t>(quantY.encode(position[3*i+1]));
+            circle.radius = static_cast<uint16_t>(quantRadius.encode(radius[i]));
+
+            if (!palette) {
+                for (int c=0; c<3; c++)
+                    scene.colorRGB[3*i+c] = static_cast<uint8_t>(quantColor.encode(color[3*i+c]));
+            }
+
+            // measure what the renderers will actually decode
+            float px, py, rad, rgb[3];
+            scene.decodeGeometry(i, px, py, rad);
+            scene.decodeColor(i, rgb[0], rgb[1], rgb[2]);
+
+            positionError = std::max(positionError, fabsf(px - position[3*i]));
+            positionError = std::max(positionError, fabsf(py - position[3*i+1]));
+            radiusError = std::max(radiusError, fabsf(rad - radius[i]));
+            for (int c=0; c<3; c++)
+                colorError = std::max(colorError, fabsf(rgb[c] - color[3*i+c]));
+        }
+
+        std::lock_guard<std::mutex> guard(errorLock);
+        scene.positionError = std::max(scene.positionError, positionError);
+        scene.radiusError = std::max(scene.radiusError, radiusError);
+        scene.colorError = std::max(scene.colorError, colorError);
+    });
+
+    return scene.positionError <= scene.positionBound &&
+           scene.radiusError <= scene.radiusBound &&
+           scene.colorError <= scene.colorBound;
+}
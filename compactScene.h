@@ -0,0 +1,94 @@
+#ifndef __COMPACT_SCENE_H__
+#define __COMPACT_SCENE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// largest number of distinct colors stored as palette indices
+#define COMPACT_PALETTE_SIZE 256
+
+// quantized circle geometry, 16-bit fixed point
+struct CompactCircle {
+    uint16_t x;
+    uint16_t y;
+    uint16_t radius;
+};
+
+// CompactScene --
+//
+// Quantized copy of the circle columns loaded by loadCircleScene.
+// Positions and radii are 16-bit fixed point over the range the scene
+// actually spans, colors are palette indices when the scene has at most
+// COMPACT_PALETTE_SIZE distinct colors and 8 bits per channel otherwise.
+// Depth is not stored: circles are kept in depth order, which is all
+// the renderers use it for.  A circle takes 7 or 9 bytes instead of 28.
+//
+// Every value decodes as origin + q * scale.
+struct CompactScene {
+
+    int numCircles;
+
+    float originX, originY;
+    float scaleX, scaleY;
+    float radiusScale;
+    std::vector<CompactCircle> circles;
+
+    // palette mode
+    std::vector<float> palette;
+    std::vector<uint8_t> colorIndex;
+    // 8 bits per channel mode
+    float colorOrigin;
+    float colorScale;
+    std::vector<uint8_t> colorRGB;
+
+    // largest decoding error measured against the float scene, and the
+    // bound the quantization guarantees
+    float positionError, positionBound;
+    float radiusError, radiusBound;
+    float colorError, colorBound;
+
+    bool usesPalette() const {
+        return !colorIndex.empty();
+    }
+
+    inline void decodeGeometry(int circleIndex, float& px, float& py, float& rad) const {
+        const CompactCircle& circle = circles[circleIndex];
+        px = originX + circle.x * scaleX;
+        py = originY + circle.y * scaleY;
+        rad = circle.radius * radiusScale;
+    }
+
+    inline void decodeColor(int circleIndex, float& r, float& g, float& b) const {
+        if (usesPalette()) {
+            const float* entry = &palette[3 * colorIndex[circleIndex]];
+            r = entry[0];
+            g = entry[1];
+            b = entry[2];
+        } else {
+            const uint8_t* rgb = &colorRGB[3 * circleIndex];
+            r = colorOrigin + rgb[0] * colorScale;
+            g = colorOrigin + rgb[1] * colorScale;
+            b = colorOrigin + rgb[2] * colorScale;
+        }
+    }
+
+    // bytes of circle data, per circle
+    size_t bytesPerCircle() const {
+        return sizeof(CompactCircle) + (usesPalette() ? 1 : 3);
+    }
+};
+
+// buildCompactScene --
+//
+// Quantizes the given float scene.  Returns false if a decoded value
+// is further from the float reference than the quantization bound.
+bool
+buildCompactScene(
+    int numCircles,
+    const float* position,
+    const float* color,
+    const float* radius,
+    CompactScene& scene);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __COUNTER_RNG_H__
+#define __COUNTER_RNG_H__
+
+#include <stdint.h>
+
+// Counter-based random numbers.
+//
+// Unlike rand(), there is no hidden state: the value returned for a
+// given (seed, index, stream) triple is always the same, no matter
+// which thread asks for it or in what order.  Circle i of a scene
+// draws all of its random attributes from counter index i, using a
+// different stream for each attribute, so any subrange of a scene
+// can be regenerated independently of the rest.
+
+
+// splitMix64 --
+//
+// The SplitMix64 output function.  A bijective mixer with good
+// avalanche behaviour: every input bit affects every output bit.
+static inline uint64_t
+splitMix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// counterRandom --
+//
+// return 64 random bits keyed by (seed, index, stream)
+static inline uint64_t
+counterRandom(uint64_t seed, uint64_t index, uint32_t stream) {
+    uint64_t key = splitMix64(seed ^ (static_cast<uint64_t>(stream) << 32));
+    return splitMix64(key ^ splitMix64(index));
+}
+
+// counterRandomFloat --
+//
+// return a random floating point value in [0,1) keyed by
+// (seed, index, stream).  Uses the top 24 bits so every value is
+// exactly representable as a float.
+static inline float
+counterRandomFloat(uint64_t seed, uint64_t index, uint32_t stream) {
+    return static_cast<float>(counterRandom(seed, index, stream) >> 40) * (1.f / 16777216.f);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#include <math.h>
+
+#include "coverage.h"
+
+// buildCoverageTable --
+//
+// Area of a disk of radius R on the inner side of a chord at signed
+// distance d from its center, divided by the disk area:
+//
+//   0.5 + (d * sqrt(R^2 - d^2) + R^2 * asin(d / R)) / (pi * R^2)
+static void
+buildCoverageTable(float* table) {
+
+    double filterRadius = COVERAGE_FILTER_RADIUS;
+    double area = M_PI * filterRadius * filterRadius;
+
+    for (int i=0; i<=COVERAGE_TABLE_SIZE; i++) {
+        double d = filterRadius * (2.0 * i / COVERAGE_TABLE_SIZE - 1.0);
+        double ratio = fmin(1.0, fmax(-1.0, d / filterRadius));
+        double h = sqrt(fmax(0.0, filterRadius * filterRadius - d * d));
+        double inside = .5 + (d * h + filterRadius * filterRadius * asin(ratio)) / area;
+        table[i] = static_cast<float>(fmin(1.0, fmax(0.0, inside)));
+    }
+}
+
+const float*
+coverageTable() {
+
+    // built once, on first use (thread safe)
+    static struct CoverageTable {
+        float entries[COVERAGE_TABLE_SIZE + 1];
+        CoverageTable() { buildCoverageTable(entries); }
+    } table;
+
+    return table.entries;
+}
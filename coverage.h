@@ -0,0 +1,84 @@
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include <math.h>
+
+// For anti-aliasing a pixel is treated as a disk of unit area (radius
+// 1/sqrt(pi) pixels) rather than a point at its center.  The coverage
+// of a pixel by a circle is the fraction of that disk inside the circle,
+// approximating the circle edge by a straight line.
+#define COVERAGE_FILTER_RADIUS 0.5641896f
+#define COVERAGE_TABLE_SIZE 256
+
+// coverageTable --
+//
+// Fraction of the pixel disk inside an edge, for signed distances from
+// the pixel center to the edge (positive inside) sampled uniformly over
+// [-COVERAGE_FILTER_RADIUS, COVERAGE_FILTER_RADIUS].  The table has
+// COVERAGE_TABLE_SIZE + 1 entries.
+const float* coverageTable();
+
+// CoverageRing --
+//
+// Per circle constants of the coverage computation, with all distances
+// in pixels (normalized coordinates are scaled by the image width).
+// Pixels closer to the center than innerDist2 are fully covered and
+// pixels beyond outerDist2 are not covered at all; only the ring in
+// between needs the edge table.
+struct CoverageRing {
+    float innerDist2;
+    float outerDist2;
+    float radiusPixels;
+    float pixelScale;
+    float maxCoverage;
+    const float* table;
+};
+
+// Extra reach of a circle's bounding box when anti-aliasing, in
+// normalized coordinates.
+static inline float
+coverageReach(int width) {
+    return COVERAGE_FILTER_RADIUS / width;
+}
+
+static inline void
+initCoverageRing(float rad, int width, CoverageRing& ring) {
+
+    float inner = rad - coverageReach(width);
+    float outer = rad + coverageReach(width);
+
+    ring.innerDist2 = inner > 0.f ? inner * inner : -1.f;
+    ring.outerDist2 = outer * outer;
+    ring.pixelScale = static_cast<float>(width);
+    ring.radiusPixels = rad * ring.pixelScale;
+    // a circle smaller than a pixel covers at most its own area
+    ring.maxCoverage = fminf(1.f, static_cast<float>(M_PI) * ring.radiusPixels * ring.radiusPixels);
+    ring.table = coverageTable();
+}
+
+// ringCoverage --
+//
+// Coverage of the pixel whose center is at squared (normalized)
+// distance pixelDist from the circle center.
+static inline float
+ringCoverage(const CoverageRing& ring, float pixelDist) {
+
+    if (pixelDist <= ring.innerDist2)
+        return 1.f;
+    if (pixelDist >= ring.outerDist2)
+        return 0.f;
+
+    float edgeDistance = ring.radiusPixels - sqrtf(pixelDist) * ring.pixelScale;
+    float position = (edgeDistance + COVERAGE_FILTER_RADIUS) * (COVERAGE_TABLE_SIZE / (2.f * COVERAGE_FILTER_RADIUS));
+    position = fminf(fmaxf(position, 0.f), static_cast<float>(COVERAGE_TABLE_SIZE));
+
+    int index = static_cast<int>(position);
+    if (index == COVERAGE_TABLE_SIZE)
+        index--;
+    float fraction = position - index;
+    float coverage = ring.table[index] + fraction * (ring.table[index+1] - ring.table[index]);
+
+    return fminf(coverage, ring.maxCoverage);
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include "cudaRenderer.h"
 #include "image.h"
 #include "sceneLoader.h"
+#include "trace.h"
 
 //Defining some constants
 
@@ -230,7 +231,13 @@ countCircles(short * blockCoord, uint * circleCountPerThreadList, uint * circleI
 // runs through the list of circles per block (in which the ordering
 // is correct), check if that pixel belongs to the circle. If so
 // it applies the shading to that pixel, otherwise pass over.
-__global__ void kernelRenderCircles() {
+//
+// Only the pixels in the region [regionMinX, regionMaxX) x
+// [regionMinY, regionMaxY) are rendered. The grid covers just the
+// blocks that intersect the region, starting at block (firstBlockX,
+// firstBlockY) of the full image.
+__global__ void kernelRenderCircles(int firstBlockX, int firstBlockY,
+		int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
 
 	//Part 1:
 	//Consists in dividing the image in small parts (one for each
@@ -261,13 +268,21 @@ __global__ void kernelRenderCircles() {
 
 	//Setting the block coordinates
 
-	short blockLeftCoord = blockIdx.x * THREADS_PER_BLOCK_X;
-	short blockRightCoord = blockLeftCoord + THREADS_PER_BLOCK_X - 1;
-	short blockTopCoord = blockIdx.y * THREADS_PER_BLOCK_Y;
-	short blockBottomCoord = blockTopCoord + THREADS_PER_BLOCK_Y - 1;
-
-
-	short blockCoord[]{blockLeftCoord,blockRightCoord,blockTopCoord,blockBottomCoord };
+	//The right and bottom coordinates are the edges of the block (one past its
+	//last pixel): the centers of the last column and row of pixels lie beyond
+	//the last pixel coordinate, so the circles covering them must be binned too
+	short blockLeftCoord = (firstBlockX + blockIdx.x) * THREADS_PER_BLOCK_X;
+	short blockRightCoord = blockLeftCoord + THREADS_PER_BLOCK_X;
+	short blockTopCoord = (firstBlockY + blockIdx.y) * THREADS_PER_BLOCK_Y;
+	short blockBottomCoord = blockTopCoord + THREADS_PER_BLOCK_Y;
+
+	//Blocks on the border of the region only need the circles that touch the
+	//part of the block inside the region
+	short blockCoord[]{
+		static_cast<short>(max(static_cast<int>(blockLeftCoord), regionMinX)),
+		static_cast<short>(min(static_cast<int>(blockRightCoord), regionMaxX)),
+		static_cast<short>(max(static_cast<int>(blockTopCoord), regionMinY)),
+		static_cast<short>(min(static_cast<int>(blockBottomCoord), regionMaxY)) };
 
 	//Compute the list of circles regarding the current block.
 	//The functions returns the total number of circles within the current
@@ -286,6 +301,13 @@ __global__ void kernelRenderCircles() {
 	uint pixelXCoord = blockLeftCoord + threadIdx.x;
 	uint pixelYCoord = blockTopCoord + threadIdx.y;
 
+	//Blocks can stick out of the region (and of the image, when its size is
+	//not a multiple of the block size, e.g. reduced resolution frames).
+	//Safe to return here: there is no __syncthreads() below this point.
+	if (static_cast<int>(pixelXCoord) < regionMinX || static_cast<int>(pixelXCoord) >= regionMaxX ||
+		static_cast<int>(pixelYCoord) < regionMinY || static_cast<int>(pixelYCoord) >= regionMaxY)
+		return;
+
 	// Computed imgPtr and the pixel center
 	float4* imgPtr = (float4*)(&cuConstRendererParams.imageData[4 * (pixelYCoord * imageWidth + pixelXCoord)]);
 	float2 pixelCenterNorm = make_float2(invWidth * (static_cast<float>(pixelXCoord) + 0.5f),
@@ -347,7 +369,7 @@ CudaRenderer::getImage() {
     // need to copy contents of the rendered image from device memory
     // before we expose the Image object to the caller
 
-    printf("Copying image data from device\n");
+    TRACE_ZONE("readback");
 
     cudaMemcpy(image->data,
                cudaDeviceImageData,
@@ -396,7 +418,7 @@ CudaRenderer::setup() {
     cudaMalloc(&cudaDevicePosition, sizeof(float) * 3 * numCircles);
     cudaMalloc(&cudaDeviceColor, sizeof(float) * 3 * numCircles);
     cudaMalloc(&cudaDeviceRadius, sizeof(float) * numCircles);
-    cudaMalloc(&cudaDeviceImageData, sizeof(float) * 4 * image->width * image->height);
+    cudaMalloc(&cudaDeviceImageData, sizeof(float) * 4 * image->allocatedWidth * image->allocatedHeight);
 
     cudaMemcpy(cudaDevicePosition, position, sizeof(float) * 3 * numCircles, cudaMemcpyHostToDevice);
     cudaMemcpy(cudaDeviceColor, color, sizeof(float) * 3 * numCircles, cudaMemcpyHostToDevice);
@@ -426,14 +448,47 @@ CudaRenderer::setup() {
 
 // allocOutputImage --
 //
-// Allocate buffer the renderer will render into.  Check status of
-// image first to avoid memory leak.
-void
+// Allocate buffer the renderer will render into.  An image of the
+// right size is kept as is; otherwise the old one goes back to the
+// framebuffer pool first.  Returns false if the pool has no memory for
+// the new one.
+bool
 CudaRenderer::allocOutputImage(int width, int height) {
 
+    if (image && image->allocatedWidth == width && image->allocatedHeight == height)
+        return setRenderResolution(width, height);
+
     if (image)
         delete image;
     image = new Image(width, height);
+    if (!image->data) {
+        delete image;
+        image = NULL;
+        return false;
+    }
+    return true;
+}
+
+// setRenderResolution --
+//
+// Render the following frames into a width x height image.  The
+// device buffer is sized for the allocated image, so only the image
+// dimensions in constant memory need to change (once setup() has
+// uploaded them).
+bool
+CudaRenderer::setRenderResolution(int width, int height) {
+
+    if (!image || !image->resize(width, height))
+        return false;
+
+    if (cudaDeviceImageData) {
+        GlobalConstants params;
+        cudaMemcpyFromSymbol(&params, cuConstRendererParams, sizeof(GlobalConstants));
+        params.imageWidth = image->width;
+        params.imageHeight = image->height;
+        cudaMemcpyToSymbol(cuConstRendererParams, &params, sizeof(GlobalConstants));
+    }
+    return true;
 }
 
 // clearImage --
@@ -443,6 +498,8 @@ CudaRenderer::allocOutputImage(int width, int height) {
 void
 CudaRenderer::clearImage() {
 
+    TRACE_ZONE("clear");
+
     // 256 threads per block is a healthy number
     dim3 blockDim(16, 16, 1);
     dim3 gridDim(
@@ -456,10 +513,36 @@ CudaRenderer::clearImage() {
 
 void
 CudaRenderer::render() {
+	renderRegion(0, 0, image->width, image->height);
+}
+
+// renderRegion --
+//
+// Launches blocks only for the part of the image grid that intersects
+// the region. Blocks stay aligned to the grid of a full frame, and every
+// pixel is shaded with the same circles in the same order, so the region
+// is bit-identical to a full render.
+void
+CudaRenderer::renderRegion(int minX, int minY, int maxX, int maxY) {
+
+	minX = CLAMP(minX, 0, image->width);
+	maxX = CLAMP(maxX, 0, image->width);
+	minY = CLAMP(minY, 0, image->height);
+	maxY = CLAMP(maxY, 0, image->height);
+
+	if (minX >= maxX || minY >= maxY)
+		return;
+
+	int firstBlockX = minX / THREADS_PER_BLOCK_X;
+	int firstBlockY = minY / THREADS_PER_BLOCK_Y;
+	int lastBlockX = (maxX - 1) / THREADS_PER_BLOCK_X;
+	int lastBlockY = (maxY - 1) / THREADS_PER_BLOCK_Y;
+
 	//numbers of threads per blocks (blockDim). If blockDim(X,Y) then there are X*Y threads per block
 	dim3 blockDim(THREADS_PER_BLOCK_X, THREADS_PER_BLOCK_Y);
 	//gridDim is the number of blocks. If gridDim(X,Y) then there are X*Y blocks
-	dim3 gridDim((image->width + THREADS_PER_BLOCK_X - 1) / THREADS_PER_BLOCK_X,(image->height + THREADS_PER_BLOCK_Y - 1) / THREADS_PER_BLOCK_Y);
-	kernelRenderCircles<<<gridDim, blockDim>>>();
+	dim3 gridDim(lastBlockX - firstBlockX + 1, lastBlockY - firstBlockY + 1);
+	TRACE_ZONE("composite");
+	kernelRenderCircles<<<gridDim, blockDim>>>(firstBlockX, firstBlockY, minX, minY, maxX, maxY);
 	cudaDeviceSynchronize();
 }
@@ -36,12 +36,16 @@ public:
 
     void loadScene(SceneName name);
 
-    void allocOutputImage(int width, int height);
+    bool allocOutputImage(int width, int height);
+
+    bool setRenderResolution(int width, int height);
 
     void clearImage();
 
     void render();
 
+    void renderRegion(int minX, int minY, int maxX, int maxY);
+
     void shadePixel(
         int circleIndex,
         float pixelCenterX, float pixelCenterY,
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include "depthSort.h"
+#include "parallel.h"
+#include "trace.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+// circles between a prefetch and its use when gathering the columns
+#define GATHER_PREFETCH 16
+
+
+// depthKey --
+//
+// Unsigned key that sorts ascending as the depth descends: the float
+// bits with the sign flipped (and all bits of negative values, so that
+// they order by magnitude the other way), then inverted.  Both zeros
+// get the same key.
+static inline uint32_t
+depthKey(float depth) {
+
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    if (bits == 0x80000000u)
+        bits = 0;
+    bits ^= (bits & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+    return ~bits;
+}
+
+// sortChunks --
+//
+// Number of chunks the circles are split into, one per thread.
+static int
+sortChunks(int numCircles) {
+    int chunks = (numCircles + DEPTH_SORT_MIN_CHUNK - 1) / DEPTH_SORT_MIN_CHUNK;
+    return std::max(1, std::min(numWorkerThreads(), chunks));
+}
+
+// gatherColumn --
+//
+// Reorders a column of width floats per circle: circle i becomes the
+// circle in the low half of items[i].
+static void
+gatherColumn(int numCircles, const std::vector<uint64_t>& items, float* column, int width,
+             std::vector<float>& scratch) {
+
+    memcpy(&scratch[0], column, sizeof(float) * width * numCircles);
+
+    parallelFor(0, numCircles, DEPTH_SORT_MIN_CHUNK, [&](int begin, int end) {
+        for (int i=begin; i<end; i++) {
+            if (i + GATHER_PREFETCH < end)
+                __builtin_prefetch(&scratch[width * static_cast<uint32_t>(items[i + GATHER_PREFETCH])]);
+            const float* src = &scratch[width * static_cast<uint32_t>(items[i])];
+            for (int c=0; c<width; c++)
+                column[width * i + c] = src[c];
+        }
+    });
+}
+
+bool
+circlesInDepthOrder(int numCircles, const float* position) {
+
+    TRACE_ZONE("depth order scan");
+
+    int numChunks = sortChunks(numCircles);
+    int chunkSize = (numCircles + numChunks - 1) / numChunks;
+    std::atomic<bool> ordered(true);
+
+    parallelFor(0, numChunks, 1, [&](int begin, int end) {
+        for (int chunk=begin; chunk<end; chunk++) {
+            // every chunk also checks the pair across its start
+            int first = std::max(1, chunk * chunkSize);
+            int last = std::min(numCircles, (chunk + 1) * chunkSize);
+            for (int i=first; i<last && ordered.load(std::memory_order_relaxed); i++) {
+                if (position[3 * i + 2] > position[3 * (i - 1) + 2]) {
+                    ordered = false;
+                    break;
+                }
+            }
+        }
+    });
+    return ordered;
+}
+
+bool
+sortCirclesByDepth(int numCircles, float* position, float* color, float* radius) {
+
+    if (circlesInDepthOrder(numCircles, position))
+        return false;
+
+    TRACE_ZONE("depth sort");
+
+    int numChunks = sortChunks(numCircles);
+    int chunkSize = (numCircles + numChunks - 1) / numChunks;
+
+    // key in the high half, circle index in the low half: one store
+    // per circle and pass
+    std::vector<uint64_t> items(numCircles);
+    std::vector<uint64_t> itemsOut(numCircles);
+    // per chunk histogram of the digit, then the chunk's next slot of
+    // every digit in the output
+    std::vector<int> counts(numChunks * RADIX_BUCKETS);
+
+    parallelFor(0, numCircles, DEPTH_SORT_MIN_CHUNK, [&](int begin, int end) {
+        for (int i=begin; i<end; i++)
+            items[i] = static_cast<uint64_t>(depthKey(position[3 * i + 2])) << 32 | static_cast<uint32_t>(i);
+    });
+
+    for (int shift=32; shift<64; shift+=RADIX_BITS) {
+
+        parallelFor(0, numChunks, 1, [&](int begin, int end) {
+            for (int chunk=begin; chunk<end; chunk++) {
+                int* count = &counts[chunk * RADIX_BUCKETS];
+                memset(count, 0, sizeof(int) * RADIX_BUCKETS);
+                int last = std::min(numCircles, (chunk + 1) * chunkSize);
+                for (int i=chunk*chunkSize; i<last; i++)
+                    count[(items[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            }
+        });
+
+        // exclusive prefix sum, digit major so that every chunk's
+        // circles of a digit follow those of the previous chunks
+        bool oneDigit = false;
+        int offset = 0;
+        for (int digit=0; digit<RADIX_BUCKETS; digit++) {
+            int digitStart = offset;
+            for (int chunk=0; chunk<numChunks; chunk++) {
+                int count = counts[chunk * RADIX_BUCKETS + digit];
+                counts[chunk * RADIX_BUCKETS + digit] = offset;
+                offset += count;
+            }
+            oneDigit |= offset - digitStart == numCircles;
+        }
+        if (oneDigit)
+            continue;
+
+        parallelFor(0, numChunks, 1, [&](int begin, int end) {
+            for (int chunk=begin; chunk<end; chunk++) {
+                int* next = &counts[chunk * RADIX_BUCKETS];
+                int last = std::min(numCircles, (chunk + 1) * chunkSize);
+                for (int i=chunk*chunkSize; i<last; i++)
+                    itemsOut[next[(items[i] >> shift) & (RADIX_BUCKETS - 1)]++] = items[i];
+            }
+        });
+        items.swap(itemsOut);
+    }
+
+    // gather the columns one at a time through a single scratch
+    // column, prefetching the circles a few iterations ahead
+    std::vector<float> scratch(3 * static_cast<size_t>(numCircles));
+    gatherColumn(numCircles, items, position, 3, scratch);
+    gatherColumn(numCircles, items, color, 3, scratch);
+    gatherColumn(numCircles, items, radius, 1, scratch);
+    return true;
+}
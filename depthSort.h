@@ -0,0 +1,33 @@
+#ifndef __DEPTH_SORT_H__
+#define __DEPTH_SORT_H__
+
+// Depth order of the circle columns (layout of loadCircleScene).
+//
+// Every renderer composites the circles in index order, farthest
+// circle first: depth (z) decreasing with the index.  The built-in
+// scenes are drawn in the order they are generated and never
+// reordered; scenes handed to the library (crSetScene) are.  A parallel
+// scan checks the order, and only if it fails are the circles
+// reordered, by a parallel LSD radix sort of the depths (four passes of
+// 8 bits over the float bits mapped to unsigned integers that sort the
+// same way, every thread scattering a contiguous chunk; passes in which
+// all depths share the digit are skipped).  The sort is stable: circles
+// of equal depth keep their relative order.
+
+// circles below which the scan and the sort run on one thread
+#define DEPTH_SORT_MIN_CHUNK 65536
+
+// circlesInDepthOrder --
+//
+// True if the depths of position (x, y, z per circle) never increase
+// with the index.
+bool circlesInDepthOrder(int numCircles, const float* position);
+
+// sortCirclesByDepth --
+//
+// Reorders the position, color and radius columns, farthest circle
+// first, unless they already are in that order.  Returns true if the
+// circles were reordered.
+bool sortCirclesByDepth(int numCircles, float* position, float* color, float* radius);
+
+#endif
@@ -1,13 +1,23 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <algorithm>
+#include <vector>
 
 #include "circleRenderer.h"
 #include "cycleTimer.h"
+#include "frameBudget.h"
 #include "image.h"
 #include "platformgl.h"
+#include "trace.h"
 
 
 void renderPicture();
 
+// progressive mode: the first frame is rendered at 1/PROGRESSIVE_START_SCALE
+// of the output resolution, and each following frame doubles the
+// resolution until the full size is reached
+#define PROGRESSIVE_START_SCALE 8
 
 static struct {
     int width;
@@ -17,7 +27,24 @@ static struct {
     bool pauseSim;
     double lastFrameTime;
 
+    // full resolution of the renderer's output image
+    int imageWidth;
+    int imageHeight;
+
+    // progressive refinement state. previewScale is the downscale
+    // factor of the next frame, 0 once the full resolution image has
+    // been rendered
+    bool progressive;
+    int previewScale;
+    double progressiveStartTime;
+
+    // render resolution controller of --budget, NULL for full resolution
+    FrameBudgetController* budget;
+
     CircleRenderer* renderer;
+    const Image* image;
+    // row order copy of a tiled framebuffer (Image::rowPixels)
+    std::vector<float> linearPixels;
 
 } gDisplay;
 
@@ -38,15 +65,41 @@ handleDisplay() {
     // simulation and rendering work is done in the renderPicture
     // function below
 
-    renderPicture();
+    // in progressive mode nothing is rendered once the image has
+    // converged to full resolution, the last image is just redrawn
+    bool renderFrame = !gDisplay.progressive || gDisplay.previewScale > 0;
+
+    if (renderFrame) {
+        renderPicture();
+        gDisplay.image = gDisplay.renderer->getImage();
+    }
 
     // the subsequent code uses OpenGL to present the state of the
     // rendered image on the screen.
 
-    const Image* img = gDisplay.renderer->getImage();
+    const Image* img = gDisplay.image;
+
+    // reduced resolution images are scaled up to the window size
+    float zoomX = static_cast<float>(gDisplay.imageWidth) / img->width;
+    float zoomY = static_cast<float>(gDisplay.imageHeight) / img->height;
+
+    if (renderFrame && gDisplay.progressive) {
+
+        double imageTime = CycleTimer::currentSeconds() - gDisplay.progressiveStartTime;
+
+        if (gDisplay.previewScale == PROGRESSIVE_START_SCALE)
+            printf("Time to first image (1/%d resolution): %.3f ms\n", gDisplay.previewScale, 1000.f * imageTime);
+
+        if (gDisplay.previewScale == 1) {
+            printf("Time to final image: %.3f ms\n", 1000.f * imageTime);
+            gDisplay.previewScale = 0;
+        } else {
+            gDisplay.previewScale /= 2;
+        }
+    }
 
-    int width = std::min(img->width, gDisplay.width);
-    int height = std::min(img->height, gDisplay.height);
+    int width = std::min(img->width, static_cast<int>(ceilf(gDisplay.width / zoomX)));
+    int height = std::min(img->height, static_cast<int>(ceilf(gDisplay.height / zoomY)));
 
     glDisable(GL_DEPTH_TEST);
     glClearColor(0.f, 0.f, 0.f, 1.f);
@@ -65,8 +118,22 @@ handleDisplay() {
     // would render to a CUDA surface object (stored in GPU memory),
     // and then bind this surface as a texture enabling it's use in
     // normal openGL rendering
+    const float* pixels = img->data;
+    if (img->tileSize) {
+        gDisplay.linearPixels.resize(4 * static_cast<size_t>(width) * height);
+        for (int y=0; y<height; y++) {
+            float* row = &gDisplay.linearPixels[4 * static_cast<size_t>(y) * width];
+            const float* src = img->rowPixels(y, 0, width, row);
+            if (src != row)
+                memcpy(row, src, sizeof(float) * 4 * width);
+        }
+        pixels = &gDisplay.linearPixels[0];
+    }
+
     glRasterPos2i(0, 0);
-    glDrawPixels(width, height, GL_RGBA, GL_FLOAT, img->data);
+    glPixelZoom(zoomX, zoomY);
+    glDrawPixels(width, height, GL_RGBA, GL_FLOAT, pixels);
+    glPixelZoom(1.f, 1.f);
 
     double currentTime = CycleTimer::currentSeconds();
 
@@ -76,7 +143,9 @@ handleDisplay() {
     gDisplay.lastFrameTime = currentTime;
 
     glutSwapBuffers();
-    glutPostRedisplay();
+
+    if (!gDisplay.progressive || gDisplay.previewScale > 0)
+        glutPostRedisplay();
 }
 
 
@@ -101,6 +170,14 @@ handleKeyPress(unsigned char key, int x, int y) {
         if (!gDisplay.pauseSim)
             gDisplay.updateSim = true;
         break;
+    case 'r':
+    case 'R':
+        // restart progressive refinement
+        if (gDisplay.progressive) {
+            gDisplay.previewScale = PROGRESSIVE_START_SCALE;
+            glutPostRedisplay();
+        }
+        break;
     }
 }
 
@@ -110,8 +187,26 @@ handleKeyPress(unsigned char key, int x, int y) {
 void
 renderPicture() {
 
+    TRACE_ZONE("frame");
     double startTime = CycleTimer::currentSeconds();
 
+    if (gDisplay.progressive) {
+        if (gDisplay.previewScale == PROGRESSIVE_START_SCALE)
+            gDisplay.progressiveStartTime = startTime;
+
+        // same scene and tile size, only the image shrinks
+        int scale = gDisplay.previewScale;
+        int width = std::max(1, gDisplay.imageWidth / scale);
+        int height = std::max(1, gDisplay.imageHeight / scale);
+        if (!gDisplay.renderer->setRenderResolution(width, height))
+            fprintf(stderr, "Error: render resolution %dx%d exceeds the output image\n", width, height);
+    } else if (gDisplay.budget) {
+        int width, height;
+        gDisplay.budget->scaledSize(gDisplay.imageWidth, gDisplay.imageHeight, width, height);
+        if (!gDisplay.renderer->setRenderResolution(width, height))
+            fprintf(stderr, "Error: render resolution %dx%d exceeds the output image\n", width, height);
+    }
+
     // clear screen
     gDisplay.renderer->clearImage();
 
@@ -131,10 +226,18 @@ renderPicture() {
         printf("Clear:    %.3f ms\n", 1000.f * (endClearTime - startTime));
         printf("Render:   %.3f ms\n", 1000.f * (endRenderTime - endSimTime));
     }
+
+    FrameBudgetController* budget = gDisplay.budget;
+    if (budget && budget->frameDone(1000.0 * (endRenderTime - startTime)) && gDisplay.printStats) {
+        int width, height;
+        budget->scaledSize(gDisplay.imageWidth, gDisplay.imageHeight, width, height);
+        printf("Scale:    %.4f, %dx%d (%.3f ms smoothed, budget %.2f ms)\n",
+               budget->scale(), width, height, budget->smoothedMs(), budget->budget());
+    }
 }
 
 void
-startRendererWithDisplay(CircleRenderer* renderer) {
+startRendererWithDisplay(CircleRenderer* renderer, bool progressive, double budgetMs) {
 
     // setup the display
 
@@ -147,6 +250,13 @@ startRendererWithDisplay(CircleRenderer* renderer) {
     gDisplay.lastFrameTime = CycleTimer::currentSeconds();
     gDisplay.width = img->width;
     gDisplay.height = img->height;
+    gDisplay.imageWidth = img->width;
+    gDisplay.imageHeight = img->height;
+    gDisplay.progressive = progressive;
+    gDisplay.previewScale = PROGRESSIVE_START_SCALE;
+    gDisplay.progressiveStartTime = gDisplay.lastFrameTime;
+    gDisplay.budget = budgetMs > 0.0 && !progressive ? new FrameBudgetController(budgetMs) : NULL;
+    gDisplay.image = img;
 
     // configure GLUT
 
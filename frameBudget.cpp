@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "frameBudget.h"
+
+
+FrameBudgetController::FrameBudgetController(double budget) {
+
+    budgetMs = budget;
+    currentStep = FRAME_BUDGET_STEPS;
+    smoothed = 0.0;
+    frames = 0;
+    fastFrames = 0;
+    changes = 0;
+}
+
+bool
+FrameBudgetController::frameDone(double frameMs) {
+
+    smoothed = frames == 0 ? frameMs : smoothed + FRAME_BUDGET_SMOOTHING * (frameMs - smoothed);
+    frames++;
+
+    int nextStep = currentStep;
+
+    if (smoothed > budgetMs) {
+        fastFrames = 0;
+        // frame time goes with the number of pixels, the square of
+        // the scale
+        double target = currentStep * sqrt(FRAME_BUDGET_TARGET * budgetMs / smoothed);
+        nextStep = std::max(FRAME_BUDGET_MIN_STEP, std::min(currentStep - 1, static_cast<int>(target)));
+    } else if (smoothed < FRAME_BUDGET_LOW * budgetMs) {
+        if (++fastFrames >= FRAME_BUDGET_UP_FRAMES && currentStep < FRAME_BUDGET_STEPS) {
+            double ratio = static_cast<double>(currentStep + 1) / currentStep;
+            if (smoothed * ratio * ratio <= FRAME_BUDGET_TARGET * budgetMs)
+                nextStep = currentStep + 1;
+        }
+    } else {
+        fastFrames = 0;
+    }
+
+    if (nextStep == currentStep)
+        return false;
+
+    // what the smoothed time would have been at the new scale, so
+    // that the frames before the change do not trigger another one
+    double ratio = static_cast<double>(nextStep) / currentStep;
+    smoothed *= ratio * ratio;
+    currentStep = nextStep;
+    fastFrames = 0;
+    changes++;
+    return true;
+}
+
+void
+FrameBudgetController::scaledSize(int fullWidth, int fullHeight, int& width, int& height) const {
+
+    width = std::max(1, (fullWidth * currentStep + FRAME_BUDGET_STEPS / 2) / FRAME_BUDGET_STEPS);
+    height = std::max(1, (fullHeight * currentStep + FRAME_BUDGET_STEPS / 2) / FRAME_BUDGET_STEPS);
+}
+
+
+bool
+startFrameBudgetReplay(const std::string& filename, double budgetMs) {
+
+    std::ifstream in(filename.c_str());
+    if (!in) {
+        fprintf(stderr, "Error: could not open %s\n", filename.c_str());
+        return false;
+    }
+
+    std::vector<double> fullMs;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        double ms;
+        if (sscanf(line.c_str(), "%lf", &ms) == 1 && ms >= 0.0)
+            fullMs.push_back(ms);
+    }
+    if (fullMs.empty()) {
+        fprintf(stderr, "Error: no frame times in %s\n", filename.c_str());
+        return false;
+    }
+
+    printf("Replaying %d frame times from %s, budget %.2f ms\n",
+           static_cast<int>(fullMs.size()), filename.c_str(), budgetMs);
+    printf("Frame   Full(ms)    Scale   Frame(ms)   Smoothed(ms)\n");
+
+    FrameBudgetController controller(budgetMs);
+    int overFull = 0;
+    int overScaled = 0;
+    double scaleSum = 0.0;
+
+    for (size_t i=0; i<fullMs.size(); i++) {
+
+        float scale = controller.scale();
+        double frameMs = fullMs[i] * scale * scale;
+        bool changed = controller.frameDone(frameMs);
+
+        overFull += fullMs[i] > budgetMs;
+        overScaled += frameMs > budgetMs;
+        scaleSum += scale;
+        printf("%-7d %-11.3f %-7.4f %-11.3f %-12.3f", static_cast<int>(i), fullMs[i], scale, frameMs,
+               controller.smoothedMs());
+        if (changed)
+            printf("  -> scale %.4f", controller.scale());
+        printf("\n");
+    }
+
+    int numFrames = static_cast<int>(fullMs.size());
+    printf("Over budget: %d of %d frames (%d at full resolution), mean scale %.3f, %d scale changes\n",
+           overScaled, numFrames, overFull, scaleSum / numFrames, controller.numChanges());
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef __FRAME_BUDGET_H__
+#define __FRAME_BUDGET_H__
+
+#include <string>
+
+// Adaptive render resolution of the interactive display (--budget).
+//
+// Dense scenes take longer than a frame to render at full resolution.
+// The display then measures the time of every frame (clear and render)
+// and scales the resolution it renders at, per axis, in steps of 1/16
+// of the full size, to stay within a frame budget; the smaller image is
+// scaled up to the window.  The controller smooths the frame times,
+// and has some hysteresis so that it does not oscillate between two
+// resolutions:
+//
+//  - above the budget it scales down right away, by as many steps as
+//    the smoothed time says are needed to land well inside the budget
+//    (frame time taken as proportional to the number of pixels)
+//  - below FRAME_BUDGET_LOW of the budget for FRAME_BUDGET_UP_FRAMES
+//    frames in a row it scales up by one step, and only if the
+//    predicted time at the larger size is still within
+//    FRAME_BUDGET_TARGET of the budget
+//
+// The controller does not know where the frame times come from:
+// --budget-replay feeds it a recorded sequence of full resolution frame
+// times, without a scene or a display, and prints its decisions.
+
+#define DEFAULT_FRAME_BUDGET_MS 33.3
+
+// resolution steps per axis, and the smallest scale (in steps)
+#define FRAME_BUDGET_STEPS 16
+#define FRAME_BUDGET_MIN_STEP 4
+
+// fractions of the budget: scale up below LOW, aim for TARGET when
+// changing the resolution
+#define FRAME_BUDGET_LOW 0.7
+#define FRAME_BUDGET_TARGET 0.85
+#define FRAME_BUDGET_UP_FRAMES 10
+
+// weight of the newest frame in the smoothed frame time
+#define FRAME_BUDGET_SMOOTHING 0.3
+
+
+class FrameBudgetController {
+
+public:
+
+    FrameBudgetController(double budgetMs);
+
+    // frameDone --
+    //
+    // Time of the frame rendered at the current scale, in milliseconds.
+    // Returns true if the scale changed for the next frame.
+    bool frameDone(double frameMs);
+
+    double budget() const { return budgetMs; }
+    int step() const { return currentStep; }
+    float scale() const { return static_cast<float>(currentStep) / FRAME_BUDGET_STEPS; }
+    double smoothedMs() const { return smoothed; }
+    int numChanges() const { return changes; }
+
+    // resolution of the next frame for the given full resolution
+    void scaledSize(int fullWidth, int fullHeight, int& width, int& height) const;
+
+private:
+
+    double budgetMs;
+    int currentStep;
+    double smoothed;
+    int frames;
+    // consecutive frames below FRAME_BUDGET_LOW of the budget
+    int fastFrames;
+    int changes;
+};
+
+// startFrameBudgetReplay --
+//
+// Runs the controller over the frame times in the file (milliseconds
+// at full resolution, one per line, '#' starts a comment) and prints
+// the scale it chooses for every frame.  A frame rendered at scale s is
+// taken to cost s^2 of its full resolution time.  Returns false if the
+// file cannot be read or holds no frame time.
+bool startFrameBudgetReplay(const std::string& filename, double budgetMs);
+
+#endif
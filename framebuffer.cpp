@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <map>
+#include <mutex>
+
+#include "framebuffer.h"
+
+// Transparent huge pages are 2MB on x86-64 and most arm64 kernels.
+// Buffers smaller than this are not worth backing with huge pages.
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t
+roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+struct FramebufferPool::State {
+    std::mutex lock;
+
+    // size of every buffer that is currently handed out
+    std::map<void*, size_t> inUse;
+    // unused buffers, by size
+    std::multimap<size_t, void*> freeList;
+};
+
+FramebufferPool&
+FramebufferPool::instance() {
+    static FramebufferPool pool;
+    return pool;
+}
+
+FramebufferPool::FramebufferPool() {
+    state = new State;
+    hugePages = false;
+    currentBytes = 0;
+    peakBytes = 0;
+}
+
+FramebufferPool::~FramebufferPool() {
+
+    trim();
+
+    // anything still in use at exit is reclaimed by the OS
+    delete state;
+}
+
+void
+FramebufferPool::setUseHugePages(bool enable) {
+    std::lock_guard<std::mutex> guard(state->lock);
+    hugePages = enable;
+}
+
+// mapBuffer --
+//
+// Get fresh memory from the OS and (if prefault is set) touch every
+// page of it, so the page faults are taken here instead of inside the
+// first frame.  Returns NULL if the OS has no memory for it.
+void*
+FramebufferPool::mapBuffer(size_t numBytes, bool prefault) {
+
+    void* ptr = NULL;
+
+#if defined(__linux__)
+    bool useHuge = hugePages && numBytes >= HUGE_PAGE_SIZE;
+
+    // huge pages can only back 2MB-aligned ranges, so over-map by one
+    // huge page and cut off the unaligned head and tail
+    size_t mapSize = useHuge ? numBytes + HUGE_PAGE_SIZE : numBytes;
+
+    ptr = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    if (useHuge) {
+        char* base = static_cast<char*>(ptr);
+        char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(base), HUGE_PAGE_SIZE));
+        size_t head = aligned - base;
+        if (head > 0)
+            munmap(base, head);
+        if (mapSize - head > numBytes)
+            munmap(aligned + numBytes, mapSize - head - numBytes);
+        ptr = aligned;
+    }
+
+#if defined(MADV_HUGEPAGE)
+    // must be requested before the pages are touched
+    if (useHuge)
+        madvise(ptr, numBytes, MADV_HUGEPAGE);
+#endif
+
+    if (prefault) {
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        volatile char* bytes = static_cast<char*>(ptr);
+        for (size_t offset=0; offset<numBytes; offset+=pageSize)
+            bytes[offset] = 0;
+    }
+#else
+    if (posix_memalign(&ptr, FRAMEBUFFER_ALIGNMENT, numBytes) != 0)
+        return NULL;
+    if (prefault)
+        memset(ptr, 0, numBytes);
+#endif
+
+    return ptr;
+}
+
+void
+FramebufferPool::unmapBuffer(void* ptr, size_t numBytes) {
+
+#if defined(__linux__)
+    munmap(ptr, numBytes);
+#else
+    free(ptr);
+#endif
+}
+
+// acquire --
+//
+// Reuse a pooled buffer of the same size if there is one, otherwise
+// map a new one.  Sizes are rounded to whole pages (whole huge pages
+// when huge pages are enabled) so that slightly different requests
+// can share buffers.
+void*
+FramebufferPool::acquire(size_t numBytes, bool prefault) {
+
+    std::lock_guard<std::mutex> guard(state->lock);
+
+    size_t granularity = 4096;
+    if (hugePages && numBytes >= HUGE_PAGE_SIZE)
+        granularity = HUGE_PAGE_SIZE;
+    size_t size = roundUp(numBytes > 0 ? numBytes : 1, granularity);
+
+    void* ptr;
+    std::multimap<size_t, void*>::iterator it = state->freeList.find(size);
+
+    if (it != state->freeList.end()) {
+        ptr = it->second;
+        state->freeList.erase(it);
+    } else {
+        ptr = mapBuffer(size, prefault);
+        if (!ptr)
+            return NULL;
+        currentBytes += size;
+        if (currentBytes > peakBytes)
+            peakBytes = currentBytes;
+    }
+
+    state->inUse[ptr] = size;
+    return ptr;
+}
+
+void
+FramebufferPool::release(void* ptr) {
+
+    if (!ptr)
+        return;
+
+    std::lock_guard<std::mutex> guard(state->lock);
+
+    // not one of ours, nothing to give back
+    std::map<void*, size_t>::iterator it = state->inUse.find(ptr);
+    if (it == state->inUse.end())
+        return;
+
+    state->freeList.insert(std::make_pair(it->second, ptr));
+    state->inUse.erase(it);
+}
+
+void
+FramebufferPool::trim() {
+
+    std::lock_guard<std::mutex> guard(state->lock);
+
+    for (std::multimap<size_t, void*>::iterator it=state->freeList.begin(); it!=state->freeList.end(); ++it) {
+        unmapBuffer(it->second, it->first);
+        currentBytes -= it->first;
+    }
+    state->freeList.clear();
+}
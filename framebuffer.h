@@ -0,0 +1,67 @@
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include <stddef.h>
+
+// Alignment of every buffer handed out by the pool (one cache line)
+#define FRAMEBUFFER_ALIGNMENT 64
+
+
+// FramebufferPool --
+//
+// Process-wide allocator for image storage.  Buffers are 64-byte
+// aligned, optionally backed by transparent huge pages, and
+// pre-faulted when first mapped so that the first frame rendered into
+// them does not pay for page faults.  Released buffers are kept and
+// handed out again to the next request of the same size, so
+// reallocating an image of the same dimensions costs nothing.
+class FramebufferPool {
+
+public:
+
+    static FramebufferPool& instance();
+
+    // returns a buffer of at least numBytes bytes, its contents are
+    // undefined, or NULL if the memory could not be mapped.  With
+    // prefault false a newly mapped buffer is left untouched, so that
+    // its pages are placed (on NUMA hosts) by the threads that first
+    // write to them
+    void* acquire(size_t numBytes, bool prefault = true);
+
+    // returns a buffer obtained from acquire() to the pool
+    void release(void* ptr);
+
+    // unmaps all buffers currently sitting unused in the pool
+    void trim();
+
+    // ask for transparent huge pages on buffers mapped from now on
+    void setUseHugePages(bool enable);
+    bool useHugePages() const { return hugePages; }
+
+    // bytes currently mapped (in use or pooled), and the maximum
+    // ever mapped at once
+    size_t mappedBytes() const { return currentBytes; }
+    size_t peakMappedBytes() const { return peakBytes; }
+
+private:
+
+    FramebufferPool();
+    ~FramebufferPool();
+    FramebufferPool(const FramebufferPool&);
+    FramebufferPool& operator=(const FramebufferPool&);
+
+    void* mapBuffer(size_t numBytes, bool prefault);
+    void unmapBuffer(void* ptr, size_t numBytes);
+
+    // lock and buffer lists, kept out of this header so that it can be
+    // included from CUDA translation units
+    struct State;
+    State* state;
+
+    bool hugePages;
+    size_t currentBytes;
+    size_t peakBytes;
+};
+
+
+#endif
@@ -1,20 +1,132 @@
 #ifndef  __IMAGE_H__
 #define  __IMAGE_H__
 
+#include <stddef.h>
+#include <string.h>
+
+#include "framebuffer.h"
+
 
 struct Image {
 
-    Image(int w, int h) {
+    // pixel storage comes from the framebuffer pool: it is 64-byte
+    // aligned and already faulted in (unless prefault is false), and
+    // goes back to the pool when the image is deleted.  data is NULL if
+    // the pool could not provide the memory.  A layoutTileSize other
+    // than 0 stores the pixels tile by tile (see pixelIndex)
+    Image(int w, int h, bool prefault = true, int layoutTileSize = 0) {
+        width = w;
+        height = h;
+        allocatedWidth = w;
+        allocatedHeight = h;
+        tileSize = layoutTileSize;
+        data = static_cast<float*>(FramebufferPool::instance().acquire(sizeof(float) * 4 * storedPixels(), prefault));
+        ownsData = true;
+    }
+
+    // wraps pixels that belong to someone else (e.g. a shared memory
+    // segment), they are not released with the image
+    Image(int w, int h, float* externalData) {
         width = w;
         height = h;
-        data = new float[4 * width * height];
+        allocatedWidth = w;
+        allocatedHeight = h;
+        tileSize = 0;
+        data = externalData;
+        ownsData = false;
+    }
+
+    ~Image() {
+        if (ownsData)
+            FramebufferPool::instance().release(data);
+    }
+
+    bool ownsPixels() const { return ownsData; }
+
+    // resize --
+    //
+    // Change the dimensions of the image without reallocating.  The
+    // pixels of the smaller image are stored compactly at the start of
+    // the buffer (row stride, or tiles per row, follow the new width).
+    // Returns false if the image does not fit in the allocated buffer.
+    bool resize(int w, int h) {
+        if (w <= 0 || h <= 0 || w > allocatedWidth || h > allocatedHeight)
+            return false;
+        width = w;
+        height = h;
+        return true;
+    }
+
+    // pixelIndex --
+    //
+    // Index of pixel (x, y) in data.  Linear images are stored row
+    // after row.  Tiled images store every tileSize x tileSize tile
+    // contiguously (row-major within the tile, tiles row-major over the
+    // image, edge tiles padded to the full size), so that a renderer
+    // working tile by tile touches one compact block of memory instead
+    // of tileSize rows a whole image row apart.
+    size_t pixelIndex(int x, int y) const {
+        if (!tileSize)
+            return static_cast<size_t>(y) * width + x;
+        size_t tilesX = (width + tileSize - 1) / tileSize;
+        size_t tile = (y / tileSize) * tilesX + x / tileSize;
+        return (tile * tileSize + y % tileSize) * tileSize + x % tileSize;
+    }
+
+    // pixels stored for the current dimensions, and for the allocated
+    // ones, padding included
+    size_t storedPixels() const { return layoutPixels(width, height); }
+    size_t allocatedPixels() const { return layoutPixels(allocatedWidth, allocatedHeight); }
+
+    // rowPixels --
+    //
+    // Pixels [minX, maxX) of row y in order, for the output stage
+    // (files, display, comparisons).  Points into data when they are
+    // contiguous, otherwise gathers them into scratch, which must hold
+    // 4 * (maxX - minX) floats.
+    const float* rowPixels(int y, int minX, int maxX, float* scratch) const {
+        if (!tileSize || (minX / tileSize == (maxX - 1) / tileSize))
+            return &data[4 * pixelIndex(minX, y)];
+        float* out = scratch;
+        for (int x=minX; x<maxX; ) {
+            int end = (x / tileSize + 1) * tileSize;
+            if (end > maxX)
+                end = maxX;
+            memcpy(out, &data[4 * pixelIndex(x, y)], sizeof(float) * 4 * (end - x));
+            out += 4 * (end - x);
+            x = end;
+        }
+        return scratch;
+    }
+
+    // clearRect --
+    //
+    // Sets the pixels of [minX, maxX) x [minY, maxY) to the color, in
+    // either layout, and leaves the others untouched.
+    void clearRect(int minX, int minY, int maxX, int maxY, float r, float g, float b, float a) {
+        for (int y=minY; y<maxY; y++) {
+            for (int x=minX; x<maxX; ) {
+                int end = tileSize ? (x / tileSize + 1) * tileSize : maxX;
+                if (end > maxX)
+                    end = maxX;
+                float* ptr = &data[4 * pixelIndex(x, y)];
+                for (int i=x; i<end; i++) {
+                    ptr[0] = r;
+                    ptr[1] = g;
+                    ptr[2] = b;
+                    ptr[3] = a;
+                    ptr += 4;
+                }
+                x = end;
+            }
+        }
     }
 
     void clear(float r, float g, float b, float a) {
 
-        int numPixels = width * height;
+        size_t numPixels = storedPixels();
         float* ptr = data;
-        for (int i=0; i<numPixels; i++) {
+        for (size_t i=0; i<numPixels; i++) {
             ptr[0] = r;
             ptr[1] = g;
             ptr[2] = b;
@@ -26,6 +138,29 @@ struct Image {
     int width;
     int height;
     float* data;
+
+    // edge of the tiles of the memory layout, 0 for linear rows
+    int tileSize;
+
+    // dimensions the buffer was allocated for
+    int allocatedWidth;
+    int allocatedHeight;
+
+private:
+
+    bool ownsData;
+
+    size_t layoutPixels(int w, int h) const {
+        if (!tileSize)
+            return static_cast<size_t>(w) * h;
+        size_t tilesX = (w + tileSize - 1) / tileSize;
+        size_t tilesY = (h + tileSize - 1) / tileSize;
+        return tilesX * tilesY * tileSize * tileSize;
+    }
+
+    // an Image owns its pixels
+    Image(const Image&);
+    Image& operator=(const Image&);
 };
 
 
@@ -3,14 +3,104 @@
 #include <getopt.h>
 #include <string>
 
+#include "autotune.h"
 #include "refRenderer.h"
 #include "cudaRenderer.h"
+#include "tiledRenderer.h"
 #include "platformgl.h"
+#include "framebuffer.h"
+#include "frameBudget.h"
+#include "planner.h"
+#include "ppm.h"
+#include "sceneLoader.h"
+#include "simulation.h"
+#include "trace.h"
+#include "videoStream.h"
+#include "workerPool.h"
 
 
-void startRendererWithDisplay(CircleRenderer* renderer);
-void startBenchmark(CircleRenderer* renderer, const std::string& rendererType, int totalFrames, const std::string& frameFilename);
-void CheckBenchmark(CircleRenderer* ref_renderer, CircleRenderer* cuda_renderer, const std::string& frameFilename);
+void startRendererWithDisplay(CircleRenderer* renderer, bool progressive, double budgetMs);
+void startBenchmark(CircleRenderer* renderer, const std::string& rendererType, int totalFrames, const std::string& frameFilename, ImageFormat format, const int* region, bool perfCounters, int numCircles, SimulationPipeline* simulation, const RenderPlan* plan);
+void CheckBenchmark(CircleRenderer* ref_renderer, CircleRenderer* cuda_renderer, const std::string& rendererType, const std::string& frameFilename);
+void startVideoStream(CircleRenderer* renderer, int totalFrames, const std::string& path, VideoFormat format, const int* region);
+void startShardedBenchmark(const std::string& rendererType, SceneName sceneName, int width, int height, int numShards, int totalFrames, const std::string& frameFilename, ImageFormat format);
+
+
+// set by --compact, applies to the tiled renderer
+static bool compactCircles = false;
+// set by --antialias
+static bool antialiasCircles = false;
+// tuning profiles of the tiled renderer, --tuning
+static std::string tuningFilename = DEFAULT_TUNING_FILE;
+// set by -t, which wins over the thread count of a tuning profile
+static bool threadsGiven = false;
+// tile list cache of the tiled renderer, --bin-cache
+static std::string binCacheDir;
+// patch / rebuild threshold of the tiled renderer's tile lists, --rebuild-threshold
+static float rebuildFraction = DEFAULT_REBUILD_FRACTION;
+// span shading threshold of the tiled renderer, chosen by the planner with -r auto
+static float spanRadius = DEFAULT_SPAN_RADIUS;
+// framebuffer of the tiled renderer stored tile by tile, --layout tiled
+static bool tiledLayout = false;
+
+// createRenderer --
+//
+// Renderer for the given type name ("cpu", "cuda" or "tiled")
+CircleRenderer*
+createRenderer(const std::string& rendererType) {
+
+    CircleRenderer* renderer;
+
+    if (rendererType.compare("cuda") == 0) {
+        renderer = new CudaRenderer();
+    } else if (rendererType.compare("tiled") == 0) {
+        TiledRenderer* tiledRenderer = new TiledRenderer();
+        tiledRenderer->setCompactScene(compactCircles);
+        tiledRenderer->setBinCacheDir(binCacheDir.c_str());
+        tiledRenderer->setRebuildFraction(rebuildFraction);
+        tiledRenderer->setSpanRadius(spanRadius);
+        tiledRenderer->setTiledLayout(tiledLayout);
+        renderer = tiledRenderer;
+    } else {
+        renderer = new RefRenderer();
+    }
+
+    if (!renderer->setAntialias(antialiasCircles))
+        fprintf(stderr, "Warning: the %s renderer does not support anti-aliasing\n", rendererType.c_str());
+    return renderer;
+}
+
+// allocRendererImage --
+//
+// Allocates the image the renderer renders into, or exits.
+void
+allocRendererImage(CircleRenderer* renderer, int width, int height) {
+
+    if (!renderer->allocOutputImage(width, height)) {
+        fprintf(stderr, "Error: could not allocate a %dx%d framebuffer\n", width, height);
+        exit(1);
+    }
+}
+
+// loadRendererScene --
+//
+// Loads the scene and sets the renderer up, with the parameters of its
+// tuning profile for the tiled renderer.  The tiled renderer allocates
+// its image again if the profile changed the tile size of a tiled
+// framebuffer, which may fail.
+void
+loadRendererScene(CircleRenderer* renderer, const std::string& rendererType, SceneName sceneName) {
+
+    renderer->loadScene(sceneName);
+    if (rendererType.compare("tiled") == 0)
+        applyTuningProfile(static_cast<TiledRenderer*>(renderer), tuningFilename, threadsGiven);
+    renderer->setup();
+
+    if (rendererType.compare("tiled") == 0 && !renderer->getImage()) {
+        fprintf(stderr, "Error: could not allocate the framebuffer\n");
+        exit(1);
+    }
+}
 
 
 void usage(const char* progname) {
@@ -18,9 +108,32 @@ void usage(const char* progname) {
     printf("Valid scenenames are: rgb, rgby, rand10k, rand100k, pattern\n");
     printf("Program Options:\n");
     printf("  -b  --bench <NUM_OF_FRAMES>    Benchmark mode, do not create display. Shows time frames\n");
-    printf("  -c  --check                Check correctness of output on one frame\n");
+    printf("  -c  --check                Check correctness of output on one frame (against cuda, or the renderer given by -r)\n");
     printf("  -f  --file  <FILENAME>     Dump frames in benchmark mode (FILENAME_xxxx.ppm) for both CPU and GPU versions\n");
-    printf("  -r  --renderer <ref/cuda>  Select renderer: ref or cuda\n");
+    printf("  -s  --size <PIXELS>        Width and height of the image (1024 by default)\n");
+    printf("  -r  --renderer <ref/cuda/tiled/auto>  Select renderer: ref, cuda, tiled (multithreaded CPU) or auto (cost model)\n");
+    printf("  -t  --threads <NUM>        Number of CPU worker threads (all hardware threads by default)\n");
+    printf("  -S  --shards <NUM_OF_SHARDS> Benchmark mode: render strips of the frame in separate processes\n");
+    printf("  -R  --region <X0,Y0,X1,Y1> Benchmark mode: render only pixels [X0,X1) x [Y0,Y1)\n");
+    printf("  -p  --progressive          Display mode: show a low resolution preview first, then refine\n");
+    printf("  -B  --budget <MS>          Display mode: scale the render resolution to keep frames within MS (%.1f with -y)\n",
+           DEFAULT_FRAME_BUDGET_MS);
+    printf("  -y  --budget-replay <FILENAME> Run the --budget controller on recorded full resolution frame times (ms per line)\n");
+    printf("  -F  --format <ppm/png/tseq> File format of dumped frames (ppm by default, tseq: one tile-delta sequence)\n");
+    printf("  -V  --video <y4m/rgb>      Stream frames as y4m or raw rgb24 video to the file, pipe or stdout (-) given by -f\n");
+    printf("  -T  --trace <FILENAME>     Write a Chrome trace (JSON) of the render phases, needs a make TRACE=1 build\n");
+    printf("  -P  --perf                 Benchmark mode: report hardware counters (IPC, cache/TLB/branch misses) per phase\n");
+    printf("  -H  --hugepages            Back framebuffers with transparent huge pages\n");
+    printf("  -A  --antialias            Anti-aliased circle edges (ref and tiled renderers)\n");
+    printf("  -C  --compact              Tiled renderer: keep circles quantized (16-bit position/radius, 8-bit color)\n");
+    printf("  -a  --autotune             Time tile sizes and thread counts of the tiled renderer on the scene, save the best\n");
+    printf("  -u  --tuning <FILENAME>    Tuning profiles of the tiled renderer (%s by default)\n", DEFAULT_TUNING_FILE);
+    printf("  -k  --bin-cache <DIR>      Tiled renderer: save the tile lists to DIR and map them in later runs\n");
+    printf("  -m  --simulate <NUM>       Benchmark mode: move the circles every frame on NUM threads, pipelined with rendering\n");
+    printf("  -i  --rebuild-threshold <FRACTION> Tiled renderer: rebuild the tile lists when more circles changed tiles (%.2f, 0: always)\n",
+           DEFAULT_REBUILD_FRACTION);
+    printf("  -l  --layout <linear/tiled> Tiled renderer: framebuffer stored row by row (default) or tile by tile\n");
+    printf("  -e  --explain              Print the rendering plan of the scene, and its predicted cost next to the measured one\n");
     printf("  -?  --help                 This message\n");
 }
 
@@ -33,10 +146,25 @@ int main(int argc, char** argv)
 
     std::string sceneNameStr;
     std::string frameFilename;
+    std::string traceFilename;
     SceneName sceneName;
-    bool useRefRenderer = true;
+    std::string rendererType = "cpu";
+    bool rendererSelected = false;
     bool checkCorrectness = false;
     bool benchmarkMode= false;
+    bool progressiveDisplay = false;
+    double frameBudgetMs = 0.0;
+    std::string budgetReplayFilename;
+    bool perfCounters = false;
+    bool autotuneMode = false;
+    bool explainPlan = false;
+    int simulationThreads = 0;
+    int region[4];
+    bool useRegion = false;
+    int numShards = 0;
+    ImageFormat frameFormat = IMAGE_FORMAT_PPM;
+    bool videoMode = false;
+    VideoFormat videoFormat = VIDEO_FORMAT_Y4M;
 
     // parse commandline options ////////////////////////////////////////////
     int opt;
@@ -45,11 +173,32 @@ int main(int argc, char** argv)
         {"check",    0, 0,  'c'},
         {"bench",    1, 0,  'b'},
         {"file",     1, 0,  'f'},
+        {"size",     1, 0,  's'},
         {"renderer", 1, 0,  'r'},
+        {"threads",  1, 0,  't'},
+        {"shards",   1, 0,  'S'},
+        {"region",   1, 0,  'R'},
+        {"progressive", 0, 0, 'p'},
+        {"format",   1, 0,  'F'},
+        {"video",    1, 0,  'V'},
+        {"trace",    1, 0,  'T'},
+        {"perf",     0, 0,  'P'},
+        {"hugepages", 0, 0, 'H'},
+        {"compact",  0, 0,  'C'},
+        {"antialias", 0, 0, 'A'},
+        {"autotune", 0, 0,  'a'},
+        {"tuning",   1, 0,  'u'},
+        {"bin-cache", 1, 0, 'k'},
+        {"simulate", 1, 0,  'm'},
+        {"rebuild-threshold", 1, 0, 'i'},
+        {"explain",  0, 0,  'e'},
+        {"layout",   1, 0,  'l'},
+        {"budget",   1, 0,  'B'},
+        {"budget-replay", 1, 0, 'y'},
         {0 ,0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "b:f:r:s:c?", long_options, NULL)) != EOF) {
+    while ((opt = getopt_long(argc, argv, "b:f:i:k:l:m:r:s:t:u:y:B:F:R:S:T:V:acepACHP?", long_options, NULL)) != EOF) {
 
         switch (opt) {
         case 'b':
@@ -60,15 +209,137 @@ int main(int argc, char** argv)
             }
             benchmarkMode = true;
             break;
+        case 's':
+            if (sscanf(optarg, "%d", &imageSize) != 1 || imageSize < 1) {
+                fprintf(stderr, "Invalid argument to -s option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
         case 'c':
             checkCorrectness = true;
             break;
+        case 'e':
+            explainPlan = true;
+            break;
         case 'f':
             frameFilename = optarg;
             break;
         case 'r':
             if (std::string(optarg).compare("cuda") == 0) {
-                useRefRenderer = false;
+                rendererType = "cuda";
+            } else if (std::string(optarg).compare("tiled") == 0) {
+                rendererType = "tiled";
+            } else if (std::string(optarg).compare("auto") == 0) {
+                rendererType = "auto";
+            }
+            rendererSelected = true;
+            break;
+        case 't': {
+            int numThreads;
+            if (sscanf(optarg, "%d", &numThreads) != 1 || numThreads < 1) {
+                fprintf(stderr, "Invalid argument to -t option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            setNumWorkerThreads(numThreads);
+            threadsGiven = true;
+            break;
+        }
+        case 'R':
+            if (sscanf(optarg, "%d,%d,%d,%d", &region[0], &region[1], &region[2], &region[3]) != 4) {
+                fprintf(stderr, "Invalid argument to -R option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            useRegion = true;
+            break;
+        case 'S':
+            if (sscanf(optarg, "%d", &numShards) != 1 || numShards < 1) {
+                fprintf(stderr, "Invalid argument to -S option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'p':
+            progressiveDisplay = true;
+            break;
+        case 'F':
+            if (std::string(optarg).compare("png") == 0) {
+                frameFormat = IMAGE_FORMAT_PNG;
+            } else if (std::string(optarg).compare("tseq") == 0) {
+                frameFormat = IMAGE_FORMAT_TILE_SEQUENCE;
+            } else if (std::string(optarg).compare("ppm") != 0) {
+                fprintf(stderr, "Invalid argument to -F option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'V':
+            if (std::string(optarg).compare("rgb") == 0) {
+                videoFormat = VIDEO_FORMAT_RGB24;
+            } else if (std::string(optarg).compare("y4m") != 0) {
+                fprintf(stderr, "Invalid argument to -V option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            videoMode = true;
+            break;
+        case 'T':
+            traceFilename = optarg;
+            break;
+        case 'P':
+            perfCounters = true;
+            break;
+        case 'H':
+            FramebufferPool::instance().setUseHugePages(true);
+            break;
+        case 'C':
+            compactCircles = true;
+            break;
+        case 'A':
+            antialiasCircles = true;
+            break;
+        case 'a':
+            autotuneMode = true;
+            break;
+        case 'u':
+            tuningFilename = optarg;
+            break;
+        case 'k':
+            binCacheDir = optarg;
+            break;
+        case 'i':
+            if (sscanf(optarg, "%f", &rebuildFraction) != 1 || rebuildFraction < 0.f) {
+                fprintf(stderr, "Invalid argument to -i option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'l':
+            if (std::string(optarg).compare("tiled") == 0) {
+                tiledLayout = true;
+            } else if (std::string(optarg).compare("linear") != 0) {
+                fprintf(stderr, "Invalid argument to -l option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'B':
+            if (sscanf(optarg, "%lf", &frameBudgetMs) != 1 || frameBudgetMs <= 0.0) {
+                fprintf(stderr, "Invalid argument to -B option\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'y':
+            budgetReplayFilename = optarg;
+            break;
+        case 'm':
+            if (sscanf(optarg, "%d", &simulationThreads) != 1 || simulationThreads < 1) {
+                fprintf(stderr, "Invalid argument to -m option\n");
+                usage(argv[0]);
+                exit(1);
             }
             break;
         case '?':
@@ -79,6 +350,28 @@ int main(int argc, char** argv)
     }
     // end parsing of commandline options //////////////////////////////////////
 
+    // the video goes to stdout: keep all the text output out of it
+    if (videoMode && (frameFilename == "" || frameFilename == "-"))
+        reserveStdoutForVideo();
+
+    if (traceFilename != "")
+        traceStart(traceFilename.c_str());
+
+    // a simulated scene changes every frame, its tile lists are not worth caching
+    if (simulationThreads > 0 && binCacheDir != "") {
+        fprintf(stderr, "Warning: --bin-cache is ignored with --simulate\n");
+        binCacheDir = "";
+    }
+
+    // the replay needs neither a scene nor a display
+    if (budgetReplayFilename != "")
+        return startFrameBudgetReplay(budgetReplayFilename,
+                                      frameBudgetMs > 0.0 ? frameBudgetMs : DEFAULT_FRAME_BUDGET_MS) ? 0 : 1;
+
+    if (progressiveDisplay && frameBudgetMs > 0.0) {
+        fprintf(stderr, "Warning: --budget is ignored with --progressive\n");
+        frameBudgetMs = 0.0;
+    }
 
     if (optind + 1 > argc) {
         fprintf(stderr, "Error: missing scene name\n");
@@ -104,8 +397,48 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    //In autotune mode the tiled renderer is timed on the scene (for the number of frames given by -b),
+    //nothing is rendered to files
+    if (autotuneMode) {
+        startAutotune(sceneName, sceneNameStr, imageSize, numberOfFrames > 0 ? numberOfFrames : AUTOTUNE_DEFAULT_FRAMES,
+                      tuningFilename, antialiasCircles, compactCircles);
+        return 0;
+    }
+
     printf("Rendering to %dx%d image\n", imageSize, imageSize);
 
+    // -r auto lets the planner choose the renderer from the scene, and
+    // --explain shows its plan (or what it predicts for the one chosen
+    // with -r)
+    RenderPlan plan;
+    bool havePlan = false;
+    if (rendererType.compare("auto") == 0 || explainPlan) {
+        int numCircles;
+        float *position, *color, *radius;
+        loadCircleScene(sceneName, numCircles, position, color, radius);
+        planRendering(plan, numCircles, position, radius, imageSize, imageSize, useRegion ? region : NULL,
+                      numWorkerThreads(), DEFAULT_TILE_SIZE, antialiasCircles);
+        delete [] position;
+        delete [] color;
+        delete [] radius;
+
+        if (rendererType.compare("auto") == 0) {
+            rendererType = plan.rendererType();
+            if (plan.strategy != PLAN_DIRECT)
+                spanRadius = plan.spanRadius;
+            havePlan = true;
+        } else {
+            havePlan = forceRenderStrategy(plan, rendererType, spanRadius);
+        }
+
+        if (explainPlan && havePlan)
+            printRenderPlan(plan);
+        else if (explainPlan)
+            printf("Plan: no cost model for the %s renderer\n", rendererType.c_str());
+        else
+            printf("Planner chose the %s renderer\n", rendererType.c_str());
+    }
+
     CircleRenderer* renderer;
 
     if (checkCorrectness) {
@@ -114,15 +447,19 @@ int main(int argc, char** argv)
         CircleRenderer* ref_renderer;
         CircleRenderer* cuda_renderer;
 
-        ref_renderer = new RefRenderer();
-        cuda_renderer = new CudaRenderer();
+        // compare against cuda unless another renderer was chosen with -r
+        std::string checkType = (rendererSelected && rendererType.compare("cpu") != 0) ? rendererType : "cuda";
+
+        ref_renderer = createRenderer("cpu");
+        cuda_renderer = createRenderer(checkType);
 
-        ref_renderer->allocOutputImage(imageSize, imageSize);
-        ref_renderer->loadScene(sceneName);
-        ref_renderer->setup();
-        cuda_renderer->allocOutputImage(imageSize, imageSize);
-        cuda_renderer->loadScene(sceneName);
-        cuda_renderer->setup();
+        allocRendererImage(ref_renderer, imageSize, imageSize);
+        loadRendererScene(ref_renderer, "cpu", sceneName);
+        allocRendererImage(cuda_renderer, imageSize, imageSize);
+        loadRendererScene(cuda_renderer, checkType, sceneName);
+
+        printf("Loaded scene with %d circles\n", sceneCircleCount(sceneName));
+        cuda_renderer->printSetupInfo();
 
         // Check the correctness between 10 frames, and the average value in time is returned
         //setting a default name for the file to dump, if the name is not given through -f
@@ -130,37 +467,60 @@ int main(int argc, char** argv)
         	frameFilename="image";
 
         // Check the correctness between 10 frames, and the average value in time is returned
-        CheckBenchmark(ref_renderer, cuda_renderer, frameFilename);
+        CheckBenchmark(ref_renderer, cuda_renderer, checkType, frameFilename);
+    }
+    else if (benchmarkMode && numShards > 0) {
+
+        // the coordinator does not render, every worker process builds its own renderer
+        if(frameFilename=="")
+        	frameFilename="image";
+
+        startShardedBenchmark(rendererType, sceneName, imageSize, imageSize,
+                              numShards, numberOfFrames, frameFilename, frameFormat);
     }
     else {
 
-        if (useRefRenderer)
-            renderer = new RefRenderer();
-        else
-            renderer = new CudaRenderer();
+        renderer = createRenderer(rendererType);
+
+        allocRendererImage(renderer, imageSize, imageSize);
+        loadRendererScene(renderer, rendererType, sceneName);
+
+        printf("Loaded scene with %d circles\n", sceneCircleCount(sceneName));
+        renderer->printSetupInfo();
 
-        renderer->allocOutputImage(imageSize, imageSize);
-        renderer->loadScene(sceneName);
-        renderer->setup();
+        // the simulation owns the scene from now on, the renderer reads its front buffer
+        SimulationPipeline* simulation = NULL;
+        if (simulationThreads > 0 && benchmarkMode && !videoMode) {
+            simulation = new SimulationPipeline(sceneName, simulationThreads);
+            if (!renderer->setSceneColumns(simulation->numCircles(), simulation->position(),
+                                           simulation->color(), simulation->radius())) {
+                fprintf(stderr, "Error: the %s renderer cannot render a simulated scene\n", rendererType.c_str());
+                return 1;
+            }
+        } else if (simulationThreads > 0) {
+            fprintf(stderr, "Warning: --simulate only applies to benchmark mode\n");
+        }
 
+        //In video mode the frames are streamed to the destination given by -f (stdout by default),
+        //for as many frames as given by -b or until the reader stops
+        if (videoMode)
+            startVideoStream(renderer, numberOfFrames, frameFilename != "" ? frameFilename : "-", videoFormat, useRegion ? region : NULL);
         //If we are in benchmark mode we don't have to show the image, but to save it
-        if (benchmarkMode && frameFilename!="")
-        	if(useRefRenderer)
-        		startBenchmark(renderer, "cpu" ,numberOfFrames, frameFilename);
-        	else
-        		startBenchmark(renderer, "cuda" ,numberOfFrames, frameFilename);
+        else if (benchmarkMode && frameFilename!="")
+        	startBenchmark(renderer, rendererType ,numberOfFrames, frameFilename, frameFormat, useRegion ? region : NULL,
+        	               perfCounters, sceneCircleCount(sceneName), simulation, explainPlan && havePlan ? &plan : NULL);
         //If we are in benchmark mode but we don't set a name for the file, we use the default "image"
         else if(benchmarkMode && frameFilename==""){
-        	if(useRefRenderer)
-        	    startBenchmark(renderer, "cpu" ,numberOfFrames, "image");
-        	else
-        	    startBenchmark(renderer, "cuda" ,numberOfFrames, "image");
+        	startBenchmark(renderer, rendererType ,numberOfFrames, "image", frameFormat, useRegion ? region : NULL,
+        	               perfCounters, sceneCircleCount(sceneName), simulation, explainPlan && havePlan ? &plan : NULL);
         }
         //...not in benchmark mode, so we show the image on screen
         else{
         	glutInit(&argc, argv);
-            startRendererWithDisplay(renderer);
+            startRendererWithDisplay(renderer, progressiveDisplay, frameBudgetMs);
         }
+
+        delete simulation;
     }
 
     return 0;
@@ -0,0 +1,136 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+#include "numaTopology.h"
+
+// parseCpuList --
+//
+// Parses a kernel cpu list such as "0-7,16-23"
+static std::vector<int>
+parseCpuList(const char* list) {
+
+    std::vector<int> cpus;
+    const char* ptr = list;
+
+    while (*ptr) {
+        char* end;
+        long first = strtol(ptr, &end, 10);
+        if (end == ptr)
+            break;
+        long last = first;
+        ptr = end;
+        if (*ptr == '-') {
+            last = strtol(ptr + 1, &end, 10);
+            ptr = end;
+        }
+        for (long cpu=first; cpu<=last; cpu++)
+            cpus.push_back(static_cast<int>(cpu));
+        if (*ptr == ',')
+            ptr++;
+        else
+            break;
+    }
+    return cpus;
+}
+
+NumaTopology
+detectNumaTopology() {
+
+    NumaTopology topology;
+    topology.numNodes = 0;
+
+#if defined(__linux__)
+    // node ids can have gaps (offline or memory-only nodes), list the
+    // node directories instead of counting up to the first missing one
+    std::vector<int> nodes;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            char* end;
+            if (strncmp(entry->d_name, "node", 4) != 0 || !isdigit(entry->d_name[4]))
+                continue;
+            long node = strtol(entry->d_name + 4, &end, 10);
+            if (*end == '\0')
+                nodes.push_back(static_cast<int>(node));
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    for (size_t i=0; i<nodes.size(); i++) {
+        char path[256];
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+        FILE* fp = fopen(path, "r");
+        if (!fp)
+            continue;
+
+        char list[4096];
+        std::vector<int> cpus;
+        if (fgets(list, sizeof(list), fp))
+            cpus = parseCpuList(list);
+        fclose(fp);
+
+        // memory-only nodes cannot run render threads
+        if (!cpus.empty())
+            topology.nodeCpus.push_back(cpus);
+    }
+#endif
+
+    if (topology.nodeCpus.empty()) {
+        unsigned int numCpus = std::thread::hardware_concurrency();
+        std::vector<int> cpus;
+        for (unsigned int cpu=0; cpu<std::max(numCpus, 1u); cpu++)
+            cpus.push_back(static_cast<int>(cpu));
+        topology.nodeCpus.push_back(cpus);
+    }
+
+    topology.numNodes = static_cast<int>(topology.nodeCpus.size());
+    return topology;
+}
+
+bool
+pinCurrentThread(const std::vector<int>& cpus) {
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i=0; i<cpus.size(); i++)
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+ScopedThreadAffinity::ScopedThreadAffinity(const std::vector<int>& cpus) {
+
+    pinned = false;
+
+#if defined(__linux__)
+    cpu_set_t set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return;
+    for (int cpu=0; cpu<CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            previousCpus.push_back(cpu);
+    pinned = pinCurrentThread(cpus);
+#endif
+}
+
+ScopedThreadAffinity::~ScopedThreadAffinity() {
+
+    if (pinned)
+        pinCurrentThread(previousCpus);
+}
@@ -0,0 +1,47 @@
+#ifndef __NUMA_TOPOLOGY_H__
+#define __NUMA_TOPOLOGY_H__
+
+#include <vector>
+
+// NumaTopology --
+//
+// The NUMA nodes of the host and the CPUs that belong to each of them,
+// as reported by /sys/devices/system/node.  Hosts without NUMA
+// information (or non-Linux hosts) are reported as a single node with
+// all CPUs.
+struct NumaTopology {
+    int numNodes;
+    std::vector<std::vector<int> > nodeCpus;
+};
+
+NumaTopology detectNumaTopology();
+
+// pinCurrentThread --
+//
+// Restrict the calling thread to the given CPUs.  Returns false if the
+// affinity could not be changed.
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+
+// ScopedThreadAffinity --
+//
+// Pins the calling thread to the given CPUs for the lifetime of the
+// object, then restores the previous affinity.
+class ScopedThreadAffinity {
+
+public:
+
+    explicit ScopedThreadAffinity(const std::vector<int>& cpus);
+    ~ScopedThreadAffinity();
+
+private:
+
+    ScopedThreadAffinity(const ScopedThreadAffinity&);
+    ScopedThreadAffinity& operator=(const ScopedThreadAffinity&);
+
+    std::vector<int> previousCpus;
+    bool pinned;
+};
+
+
+#endif
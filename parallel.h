@@ -0,0 +1,43 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "workerPool.h"
+
+// parallelFor --
+//
+// Splits [begin, end) into contiguous chunks of at least minChunk
+// items, at most one per worker thread, and calls body(chunkBegin,
+// chunkEnd) for each of them concurrently.  The calling thread
+// handles the first chunk and returns once all chunks are done.
+template <typename Body>
+void
+parallelFor(int begin, int end, int minChunk, const Body& body) {
+
+    int count = end - begin;
+    if (count <= 0)
+        return;
+
+    int numChunks = std::min(numWorkerThreads(), (count + minChunk - 1) / std::max(minChunk, 1));
+    numChunks = std::max(numChunks, 1);
+    int chunkSize = (count + numChunks - 1) / numChunks;
+
+    std::vector<std::thread> workers;
+    for (int chunk=1; chunk<numChunks; chunk++) {
+        int chunkBegin = begin + chunk * chunkSize;
+        int chunkEnd = std::min(end, chunkBegin + chunkSize);
+        if (chunkBegin >= chunkEnd)
+            break;
+        workers.push_back(std::thread([=, &body]() { body(chunkBegin, chunkEnd); }));
+    }
+
+    body(begin, std::min(end, begin + chunkSize));
+
+    for (size_t i=0; i<workers.size(); i++)
+        workers[i].join();
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "perfCounters.h"
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__)
+
+struct CounterConfig {
+    unsigned int type;
+    unsigned long long config;
+};
+
+// cacheEvent --
+//
+// perf_event config of a read miss in the given cache.
+static CounterConfig
+cacheEvent(unsigned long long cache) {
+    CounterConfig event;
+    event.type = PERF_TYPE_HW_CACHE;
+    event.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    return event;
+}
+
+static CounterConfig
+hardwareEvent(unsigned long long config) {
+    CounterConfig event;
+    event.type = PERF_TYPE_HARDWARE;
+    event.config = config;
+    return event;
+}
+
+// counterConfigs --
+//
+// Events tried for a counter, in order of preference: some PMUs do not
+// expose last level cache read misses, but do count the generic cache
+// misses (which are last level misses on x86).
+static std::vector<CounterConfig>
+counterConfigs(PerfCounter counter) {
+
+    std::vector<CounterConfig> configs;
+    switch (counter) {
+    case PERF_CYCLES:
+        configs.push_back(hardwareEvent(PERF_COUNT_HW_CPU_CYCLES));
+        break;
+    case PERF_INSTRUCTIONS:
+        configs.push_back(hardwareEvent(PERF_COUNT_HW_INSTRUCTIONS));
+        break;
+    case PERF_LLC_MISSES:
+        configs.push_back(cacheEvent(PERF_COUNT_HW_CACHE_LL));
+        configs.push_back(hardwareEvent(PERF_COUNT_HW_CACHE_MISSES));
+        break;
+    case PERF_DTLB_MISSES:
+        configs.push_back(cacheEvent(PERF_COUNT_HW_CACHE_DTLB));
+        break;
+    case PERF_BRANCH_MISSES:
+        configs.push_back(hardwareEvent(PERF_COUNT_HW_BRANCH_MISSES));
+        break;
+    default:
+        break;
+    }
+    return configs;
+}
+
+static int
+openCounter(const CounterConfig& event, int tid) {
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // threads started later by this one are counted too; only user
+    // space is counted, which perf_event_paranoid <= 2 allows
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+}
+
+// processThreads --
+//
+// Thread ids of the calling process.
+static std::vector<int>
+processThreads() {
+
+    std::vector<int> tids;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        tids.push_back(0);
+        return tids;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int tid = atoi(entry->d_name);
+        if (tid > 0)
+            tids.push_back(tid);
+    }
+    closedir(dir);
+    return tids;
+}
+
+#endif
+
+
+PerfCounters::PerfCounters() {
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+int
+PerfCounters::open() {
+
+    close();
+
+#if defined(__linux__)
+    std::vector<int> tids = processThreads();
+    int numAvailable = 0;
+    int firstError = 0;
+    std::string missing;
+
+    for (int counter=0; counter<PERF_NUM_COUNTERS; counter++) {
+
+        std::vector<CounterConfig> configs = counterConfigs(static_cast<PerfCounter>(counter));
+
+        for (size_t c=0; c<configs.size() && fds[counter].empty(); c++) {
+            for (size_t t=0; t<tids.size(); t++) {
+                int fd = openCounter(configs[c], tids[t]);
+                if (fd >= 0) {
+                    fds[counter].push_back(fd);
+                } else if (t == 0) {
+                    // the calling thread: the event is not available
+                    if (!firstError)
+                        firstError = errno;
+                    break;
+                }
+                // otherwise the thread exited in the meantime
+            }
+        }
+
+        if (fds[counter].empty()) {
+            missing += missing.empty() ? "" : ", ";
+            missing += counterName(static_cast<PerfCounter>(counter));
+        } else {
+            numAvailable++;
+        }
+    }
+
+    if (numAvailable == 0) {
+        fprintf(stderr, "Warning: hardware counters unavailable (%s)%s\n", strerror(firstError),
+                firstError == EACCES || firstError == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+    } else if (!missing.empty()) {
+        fprintf(stderr, "Warning: counters not available on this host: %s\n", missing.c_str());
+    }
+    return numAvailable;
+#else
+    fprintf(stderr, "Warning: hardware counters are only supported on Linux\n");
+    return 0;
+#endif
+}
+
+void
+PerfCounters::close() {
+
+    for (int counter=0; counter<PERF_NUM_COUNTERS; counter++) {
+#if defined(__linux__)
+        for (size_t i=0; i<fds[counter].size(); i++)
+            ::close(fds[counter][i]);
+#endif
+        fds[counter].clear();
+    }
+}
+
+void
+PerfCounters::read(PerfSample& sample) const {
+
+    for (int counter=0; counter<PERF_NUM_COUNTERS; counter++) {
+
+        sample.value[counter] = 0.0;
+        sample.timeEnabled[counter] = 0.0;
+        sample.timeRunning[counter] = 0.0;
+
+#if defined(__linux__)
+        for (size_t i=0; i<fds[counter].size(); i++) {
+            // value, time enabled, time running
+            unsigned long long values[3];
+            if (::read(fds[counter][i], values, sizeof(values)) != sizeof(values))
+                continue;
+            sample.value[counter] += static_cast<double>(values[0]);
+            sample.timeEnabled[counter] += static_cast<double>(values[1]);
+            sample.timeRunning[counter] += static_cast<double>(values[2]);
+        }
+#endif
+    }
+}
+
+double
+PerfCounters::delta(const PerfSample& start, const PerfSample& end, PerfCounter counter) const {
+
+    if (!available(counter))
+        return -1.0;
+
+    double running = end.timeRunning[counter] - start.timeRunning[counter];
+    double enabled = end.timeEnabled[counter] - start.timeEnabled[counter];
+    if (running <= 0.0)
+        return -1.0;
+
+    // the counter was multiplexed with others for part of the interval
+    return (end.value[counter] - start.value[counter]) * enabled / running;
+}
+
+const char*
+PerfCounters::counterName(PerfCounter counter) {
+
+    switch (counter) {
+    case PERF_CYCLES:        return "cycles";
+    case PERF_INSTRUCTIONS:  return "instructions";
+    case PERF_LLC_MISSES:    return "LLC misses";
+    case PERF_DTLB_MISSES:   return "dTLB misses";
+    case PERF_BRANCH_MISSES: return "branch misses";
+    default:                 return "unknown";
+    }
+}
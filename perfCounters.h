@@ -0,0 +1,67 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <vector>
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUM_COUNTERS
+} PerfCounter;
+
+
+// PerfSample --
+//
+// Counter values summed over the threads of the process at one point
+// in time.  Counters that are time-multiplexed by the kernel are
+// scaled by the fraction of the time they were actually counting.
+struct PerfSample {
+    double value[PERF_NUM_COUNTERS];
+    double timeEnabled[PERF_NUM_COUNTERS];
+    double timeRunning[PERF_NUM_COUNTERS];
+};
+
+
+// PerfCounters --
+//
+// Hardware counters (Linux perf_event, user space only) on every
+// thread of the process, including the threads it starts later.  Any
+// counter that cannot be opened (no PMU in a VM, perf_event_paranoid,
+// non-Linux host) is simply reported as unavailable.
+class PerfCounters {
+
+public:
+
+    PerfCounters();
+    ~PerfCounters();
+
+    // Opens the counters, returns the number of counters available.
+    // Worker threads must have been started already.
+    int open();
+
+    void close();
+
+    bool available(PerfCounter counter) const { return !fds[counter].empty(); }
+
+    void read(PerfSample& sample) const;
+
+    // counted events of counter between two samples, or -1 if it is
+    // unavailable (or did not count at all in between)
+    double delta(const PerfSample& start, const PerfSample& end, PerfCounter counter) const;
+
+    static const char* counterName(PerfCounter counter);
+
+private:
+
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    // one file descriptor per thread for every counter
+    std::vector<int> fds[PERF_NUM_COUNTERS];
+};
+
+
+#endif
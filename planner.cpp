@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "planner.h"
+#include "coverage.h"
+#include "cycleTimer.h"
+#include "subPixel.h"
+#include "util.h"
+
+// Cost model, in units of one pixel of the box loop of the tiled
+// renderer (test + blend) on a tile in L1 (see calibrateUnit), fitted on
+// the built-in scenes rendered on one thread.
+
+// tiled renderer: binning, per circle and per tile list entry
+#define BIN_CIRCLE_COST   2.f
+#define BIN_ENTRY_COST    2.f
+// setting up a circle in a tile, a pixel of its box, and splatting a
+// sub-pixel circle
+#define TILE_CIRCLE_COST  16.f
+#define BOX_PIXEL_COST    1.4f
+#define SPLAT_COST        4.f
+// a row span (solving and correcting its ends), and a covered pixel
+#define SPAN_ROW_COST     4.f
+#define SPAN_PIXEL_COST   1.35f
+// factor of a pixel of the anti-aliased box loop (estimated)
+#define AA_PIXEL_FACTOR   1.5f
+// scheduling and compositing of a tile (serial), and the loss to load
+// imbalance of the parallel phases
+#define TILE_COST         40.f
+#define IMBALANCE         1.15f
+
+// RefRenderer: a circle, a pixel of its box (shadePixel) and a splat.
+// Its pixels also cost more as the overdraw grows: a circle's rows are
+// short, and most framebuffer lines it revisits were evicted since the
+// last circle that covered them
+#define DIRECT_CIRCLE_COST  8.f
+#define DIRECT_PIXEL_COST   1.3f
+#define DIRECT_REVISIT_COST 1.f
+#define DIRECT_SPLAT_COST   6.f
+
+// the unit is the fastest of this many timings of a small tile
+#define CALIBRATION_RUNS 32
+
+static const char* strategyNames[PLAN_NUM_STRATEGIES] = { "direct", "tiled", "spans" };
+
+
+// calibrateUnit --
+//
+// Nanoseconds per pixel of the box loop of the tiled renderer on this
+// host, timed on a circle filling a small tile.  The fastest run is
+// kept, the others were interrupted or ran on a cold cache.
+static double
+calibrateUnit() {
+
+    const int size = 64;
+    std::vector<float> pixels(4 * size * size, 0.f);
+    float invSize = 1.f / size;
+    float px = .5f, py = .5f;
+    float maxDist = .45f * .45f;
+    float colR = .3f, colG = .6f, colB = .9f;
+    float alpha = .5f;
+    float oneMinusAlpha = 1.f - alpha;
+
+    double best = 0.0;
+    for (int run=0; run<CALIBRATION_RUNS; run++) {
+        double startTime = CycleTimer::currentSeconds();
+        for (int pixelY=0; pixelY<size; pixelY++) {
+            float* imgPtr = &pixels[4 * pixelY * size];
+            float pixelCenterNormY = invSize * (static_cast<float>(pixelY) + 0.5f);
+            for (int pixelX=0; pixelX<size; pixelX++) {
+                float pixelCenterNormX = invSize * (static_cast<float>(pixelX) + 0.5f);
+                float diffX = px - pixelCenterNormX;
+                float diffY = py - pixelCenterNormY;
+                if (diffX * diffX + diffY * diffY <= maxDist) {
+                    imgPtr[0] = alpha * colR + oneMinusAlpha * imgPtr[0];
+                    imgPtr[1] = alpha * colG + oneMinusAlpha * imgPtr[1];
+                    imgPtr[2] = alpha * colB + oneMinusAlpha * imgPtr[2];
+                    imgPtr[3] += alpha;
+                }
+                imgPtr += 4;
+            }
+        }
+        double elapsed = CycleTimer::currentSeconds() - startTime;
+        best = run == 0 ? elapsed : std::min(best, elapsed);
+    }
+
+    // keep the loop from being optimized away
+    volatile float sink = pixels[4 * (size / 2 * size + size / 2) + 3];
+    (void)sink;
+    return 1e9 * best / (size * size);
+}
+
+// radiusClass --
+//
+// Histogram class of a radius in pixels.
+static int
+radiusClass(float pixels) {
+    if (pixels < 1.f)
+        return 0;
+    return std::min(PLAN_RADIUS_CLASSES - 1, 1 + static_cast<int>(floorf(log2f(pixels))));
+}
+
+// classMinRadius --
+//
+// Smallest radius in pixels of a class.
+static float
+classMinRadius(int c) {
+    return c == 0 ? 0.f : static_cast<float>(1 << (c - 1));
+}
+
+// shadeUnits --
+//
+// Units spent by the tiled renderer shading the circles of a class, as
+// spans or not.
+static double
+shadeUnits(const RenderPlan& plan, const PlanRadiusClass& rc, bool spans) {
+
+    double splat = SPLAT_COST * rc.subPixelCircles;
+    double setup = TILE_CIRCLE_COST * (rc.tileEntries - rc.subPixelCircles);
+    if (spans)
+        return splat + setup + SPAN_ROW_COST * rc.rows + SPAN_PIXEL_COST * rc.coveredPixels;
+    return splat + setup + (plan.antialias ? AA_PIXEL_FACTOR : 1.f) * BOX_PIXEL_COST * rc.boxPixels;
+}
+
+const char*
+RenderPlan::rendererType() const {
+    return strategy == PLAN_DIRECT ? "cpu" : "tiled";
+}
+
+double
+predictedTiledMs(const RenderPlan& plan, float spanRadius) {
+
+    double bin = 0.0, shade = 0.0;
+    for (int c=0; c<PLAN_RADIUS_CLASSES; c++) {
+        const PlanRadiusClass& rc = plan.classes[c];
+        bin += BIN_CIRCLE_COST * rc.circles + BIN_ENTRY_COST * rc.tileEntries;
+        bool spans = !plan.antialias && spanRadius > 0.f && c > 0 && classMinRadius(c) >= spanRadius;
+        shade += shadeUnits(plan, rc, spans);
+    }
+
+    int tilesX = (plan.width + plan.tileSize - 1) / plan.tileSize;
+    int tilesY = (plan.height + plan.tileSize - 1) / plan.tileSize;
+    double units = IMBALANCE * (bin + shade) / plan.numThreads + TILE_COST * tilesX * tilesY;
+    return 1e-6 * plan.unitNs * units;
+}
+
+void
+planRendering(RenderPlan& plan, int numCircles, const float* position, const float* radius,
+              int width, int height, const int* region, int numThreads, int tileSize, bool antialias) {
+
+    plan.numCircles = numCircles;
+    plan.width = width;
+    plan.height = height;
+    plan.numThreads = std::max(numThreads, 1);
+    plan.tileSize = tileSize;
+    plan.antialias = antialias;
+    plan.forced = false;
+    for (int c=0; c<PLAN_RADIUS_CLASSES; c++) {
+        PlanRadiusClass& rc = plan.classes[c];
+        rc.circles = rc.subPixelCircles = 0;
+        rc.boxPixels = rc.coveredPixels = rc.rows = rc.tileEntries = 0.0;
+    }
+
+    int regionMinX = region ? CLAMP(region[0], 0, width) : 0;
+    int regionMinY = region ? CLAMP(region[1], 0, height) : 0;
+    int regionMaxX = region ? CLAMP(region[2], 0, width) : width;
+    int regionMaxY = region ? CLAMP(region[3], 0, height) : height;
+    plan.regionPixels = std::max(0.0, static_cast<double>(regionMaxX - regionMinX) * (regionMaxY - regionMinY));
+
+    // the screen boxes of RefRenderer::render, clamped to the region
+    double coveredPixels = 0.0;
+    for (int i=0; i<numCircles; i++) {
+
+        float px = position[3 * i];
+        float py = position[3 * i + 1];
+        float rad = radius[i];
+        if (rad <= 0.f)
+            continue;
+
+        float reach = antialias ? rad + coverageReach(width) : rad;
+        int minX = CLAMP(static_cast<int>((px - reach) * width), regionMinX, regionMaxX);
+        int maxX = CLAMP(static_cast<int>((px + reach) * width) + 1, regionMinX, regionMaxX);
+        int minY = CLAMP(static_cast<int>((py - reach) * height), regionMinY, regionMaxY);
+        int maxY = CLAMP(static_cast<int>((py + reach) * height) + 1, regionMinY, regionMaxY);
+        if (minX >= maxX || minY >= maxY)
+            continue;
+
+        float radiusPixels = rad * width;
+        PlanRadiusClass& rc = plan.classes[radiusClass(radiusPixels)];
+        rc.circles++;
+        int tileColumns = (maxX - 1) / tileSize - minX / tileSize + 1;
+        rc.tileEntries += static_cast<double>(tileColumns) * ((maxY - 1) / tileSize - minY / tileSize + 1);
+
+        // the disc covers pi/4 of its box (the same share of the box
+        // when it is clipped)
+        double boxPixels = static_cast<double>(maxX - minX) * (maxY - minY);
+        double fullBox = 4.0 * reach * reach * width * height;
+        double covered = boxPixels * std::min(1.0, M_PI * rad * rad * width * height / std::max(fullBox, 1.0));
+        coveredPixels += covered;
+
+        if (!antialias && isSubPixelCircle(rad, width, height)) {
+            rc.subPixelCircles++;
+            continue;
+        }
+        rc.boxPixels += boxPixels;
+        rc.coveredPixels += covered;
+        // every tile shades its own part of the rows
+        rc.rows += static_cast<double>(maxY - minY) * tileColumns;
+    }
+    plan.overdraw = plan.regionPixels > 0.0 ? coveredPixels / plan.regionPixels : 0.0;
+
+    plan.unitNs = calibrateUnit();
+
+    // direct: everything on one thread
+    double directPixel = (antialias ? AA_PIXEL_FACTOR : 1.f) *
+                         (DIRECT_PIXEL_COST + DIRECT_REVISIT_COST * std::max(0.0, 1.0 - 1.0 / std::max(plan.overdraw, 1e-6)));
+    double direct = 0.0;
+    for (int c=0; c<PLAN_RADIUS_CLASSES; c++) {
+        const PlanRadiusClass& rc = plan.classes[c];
+        direct += DIRECT_CIRCLE_COST * rc.circles + DIRECT_SPLAT_COST * rc.subPixelCircles + directPixel * rc.boxPixels;
+    }
+    plan.predictedMs[PLAN_DIRECT] = 1e-6 * plan.unitNs * direct;
+    plan.predictedMs[PLAN_TILED] = predictedTiledMs(plan, 0.f);
+
+    // spans pay off from some radius on: take the smallest class from
+    // which every class is cheaper as spans
+    plan.spanRadius = 0.f;
+    if (!antialias) {
+        for (int c=PLAN_RADIUS_CLASSES-1; c>0; c--) {
+            const PlanRadiusClass& rc = plan.classes[c];
+            if (rc.circles == rc.subPixelCircles)
+                continue;
+            if (shadeUnits(plan, rc, true) >= shadeUnits(plan, rc, false))
+                break;
+            plan.spanRadius = classMinRadius(c);
+        }
+    }
+    plan.predictedMs[PLAN_SPANS] = plan.spanRadius > 0.f ? predictedTiledMs(plan, plan.spanRadius)
+                                                         : plan.predictedMs[PLAN_TILED];
+
+    plan.strategy = PLAN_DIRECT;
+    for (int s=0; s<PLAN_NUM_STRATEGIES; s++)
+        if (plan.predictedMs[s] < plan.predictedMs[plan.strategy])
+            plan.strategy = static_cast<PlanStrategy>(s);
+}
+
+bool
+forceRenderStrategy(RenderPlan& plan, const std::string& rendererType, float spanRadius) {
+
+    if (rendererType.compare("cpu") == 0) {
+        plan.strategy = PLAN_DIRECT;
+    } else if (rendererType.compare("tiled") == 0) {
+        plan.spanRadius = plan.antialias ? 0.f : spanRadius;
+        plan.strategy = plan.spanRadius > 0.f ? PLAN_SPANS : PLAN_TILED;
+        plan.predictedMs[plan.strategy] = predictedTiledMs(plan, plan.spanRadius);
+    } else {
+        return false;
+    }
+    plan.forced = true;
+    return true;
+}
+
+void
+printRenderPlan(const RenderPlan& plan) {
+
+    printf("Plan: %d circles over %.0f pixels, overdraw %.2f, %d threads, model unit %.2f ns\n",
+           plan.numCircles, plan.regionPixels, plan.overdraw, plan.numThreads, plan.unitNs);
+    printf("  Radius(px)  Circles   Sub-pixel  Box pixels   Covered      Tile entries  Tile rows   Path\n");
+    for (int c=0; c<PLAN_RADIUS_CLASSES; c++) {
+        const PlanRadiusClass& rc = plan.classes[c];
+        if (rc.circles == 0)
+            continue;
+
+        char range[32];
+        if (c == 0)
+            sprintf(range, "< 1");
+        else if (c == PLAN_RADIUS_CLASSES - 1)
+            sprintf(range, ">= %d", 1 << (c - 1));
+        else
+            sprintf(range, "%d-%d", 1 << (c - 1), 1 << c);
+
+        const char* path;
+        if (plan.strategy == PLAN_DIRECT)
+            path = rc.subPixelCircles == rc.circles ? "splat" : "box";
+        else if (rc.subPixelCircles == rc.circles)
+            path = "splat";
+        else if (plan.strategy == PLAN_SPANS && c > 0 && classMinRadius(c) >= plan.spanRadius)
+            path = "span";
+        else
+            path = rc.subPixelCircles > 0 ? "box/splat" : "box";
+
+        printf("  %-11s %-9d %-10d %-12.0f %-12.0f %-13.0f %-11.0f %s\n", range, rc.circles, rc.subPixelCircles,
+               rc.boxPixels, rc.coveredPixels, rc.tileEntries, rc.rows, path);
+    }
+
+    printf("  Predicted:");
+    for (int s=0; s<PLAN_NUM_STRATEGIES; s++)
+        printf(" %s %.3f ms%s", strategyNames[s], plan.predictedMs[s], s + 1 < PLAN_NUM_STRATEGIES ? "," : "\n");
+    if (plan.strategy == PLAN_SPANS)
+        printf("  %s: %s renderer, spans from a radius of %.0f pixels, %.3f ms predicted\n",
+               plan.forced ? "Forced" : "Chosen", plan.rendererType(), plan.spanRadius, plan.predictedMs[plan.strategy]);
+    else
+        printf("  %s: %s renderer (%s), %.3f ms predicted\n", plan.forced ? "Forced" : "Chosen",
+               plan.rendererType(), strategyNames[plan.strategy], plan.predictedMs[plan.strategy]);
+}
@@ -0,0 +1,107 @@
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+#include <string>
+
+// Choice of the rendering strategy for a scene (-r auto, --explain).
+//
+// No single strategy wins everywhere: the serial bounding box loop of
+// RefRenderer has no overhead at all for a few huge circles, binning
+// pays off as soon as there are many circles to spread over threads,
+// large circles are cheaper to shade as row spans than pixel by pixel,
+// and sub-pixel circles as 2x2 splats.  The planner summarizes the
+// scene once, at load time (circle count, histogram of the radii in
+// pixels, pixels covered and average overdraw), predicts the cost of a
+// frame with a linear cost model for every strategy, and picks the
+// cheapest one:
+//
+//   direct   RefRenderer, every circle over its box, on one thread
+//   tiled    TiledRenderer, every binned circle over its box within the
+//            tile
+//   spans    TiledRenderer, with the radius classes that are cheaper as
+//            row spans shaded that way (TiledRenderer::setSpanRadius)
+//
+// Within both renderers, sub-pixel circles are always splatted (unless
+// anti-aliasing, which also rules out spans).  The model counts work in
+// units of one pixel of the tiled renderer's box loop; a short timing
+// of that loop at planning time converts units to milliseconds on the
+// host.
+
+// radius classes of the histogram: below 1 pixel, then powers of two
+// up to the last one, which holds all larger circles
+#define PLAN_RADIUS_CLASSES 10
+
+enum PlanStrategy {
+    PLAN_DIRECT,
+    PLAN_TILED,
+    PLAN_SPANS,
+    PLAN_NUM_STRATEGIES
+};
+
+// work of the circles of one radius class, over the planned region
+struct PlanRadiusClass {
+    int circles;
+    int subPixelCircles;
+    double boxPixels;
+    double coveredPixels;
+    // rows of the circles within the tiles
+    double rows;
+    double tileEntries;
+};
+
+struct RenderPlan {
+    int numCircles;
+    int width;
+    int height;
+    double regionPixels;
+    int numThreads;
+    int tileSize;
+    bool antialias;
+
+    PlanRadiusClass classes[PLAN_RADIUS_CLASSES];
+    // average number of circles covering a pixel of the region
+    double overdraw;
+
+    // host cost of one unit of the model, in nanoseconds
+    double unitNs;
+    // predicted milliseconds per frame of every strategy
+    double predictedMs[PLAN_NUM_STRATEGIES];
+    // radius in pixels from which PLAN_SPANS shades spans (0: none)
+    float spanRadius;
+
+    PlanStrategy strategy;
+    // the strategy was set by -r rather than chosen
+    bool forced;
+
+    // renderer type of the strategy ("cpu" or "tiled")
+    const char* rendererType() const;
+};
+
+// planRendering --
+//
+// Summarizes the scene (positions and radii in the layout of
+// loadCircleScene) rendered over the region (NULL for the whole
+// width x height image) and chooses the cheapest strategy.
+void planRendering(RenderPlan& plan, int numCircles, const float* position, const float* radius,
+                   int width, int height, const int* region, int numThreads, int tileSize, bool antialias);
+
+// forceRenderStrategy --
+//
+// Makes the plan follow the renderer chosen with -r instead, with the
+// given span radius for the tiled renderer.  Returns false for a
+// renderer the model does not cover (cuda).
+bool forceRenderStrategy(RenderPlan& plan, const std::string& rendererType, float spanRadius);
+
+// predictedTiledMs --
+//
+// Predicted milliseconds per frame of the tiled renderer shading spans
+// from the given radius in pixels (0: none).
+double predictedTiledMs(const RenderPlan& plan, float spanRadius);
+
+// printRenderPlan --
+//
+// The scene summary, the predicted cost of every strategy and the plan
+// (--explain).
+void printRenderPlan(const RenderPlan& plan);
+
+#endif
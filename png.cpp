@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <zlib.h>
+
+#include "image.h"
+#include "parallel.h"
+#include "ppm.h"
+#include "util.h"
+
+// Rows are compressed in independent bands, one per worker thread.
+// Bands smaller than this compress noticeably worse than one stream.
+static const int MIN_ROWS_PER_BAND = 32;
+
+// Speed over size: level 1 is several times faster than the zlib
+// default and loses little on the large flat areas of our frames
+static const int PNG_COMPRESSION_LEVEL = 1;
+
+struct PNGBand {
+    std::vector<unsigned char> compressed;
+    uLong adler;
+    uLong rawSize;
+};
+
+static void
+putBigEndian32(std::vector<unsigned char>& out, unsigned int value) {
+    out.push_back((value >> 24) & 0xff);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+// writeChunk --
+//
+// write one PNG chunk: length, type, payload and CRC of type+payload
+static size_t
+writeChunk(FILE* fp, const char* type, const unsigned char* data, size_t length) {
+
+    std::vector<unsigned char> header;
+    putBigEndian32(header, static_cast<unsigned int>(length));
+    header.insert(header.end(), type, type + 4);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(type), 4);
+    if (length > 0)
+        crc = crc32(crc, data, static_cast<uInt>(length));
+
+    std::vector<unsigned char> trailer;
+    putBigEndian32(trailer, static_cast<unsigned int>(crc));
+
+    fwrite(&header[0], 1, header.size(), fp);
+    if (length > 0)
+        fwrite(data, 1, length, fp);
+    fwrite(&trailer[0], 1, trailer.size(), fp);
+
+    return header.size() + length + trailer.size();
+}
+
+// compressBand --
+//
+// Converts image rows [rowStart, rowEnd) of the PNG (row 0 is the top
+// of the picture, i.e. the last row of the image) to filtered RGB8
+// scanlines and deflates them as a raw deflate stream.  All bands but
+// the last end with a sync flush, which byte-aligns the output without
+// marking the last block, so the bands can simply be concatenated
+// into a single valid deflate stream.
+static void
+compressBand(const Image* image, int rowStart, int rowEnd, bool lastBand, PNGBand& band) {
+
+    int width = image->width;
+    size_t scanlineSize = 1 + 3 * static_cast<size_t>(width);
+    std::vector<unsigned char> raw(scanlineSize * (rowEnd - rowStart));
+    std::vector<float> scratch(4 * width);
+
+    for (int row=rowStart; row<rowEnd; row++) {
+
+        const float* ptr = image->rowPixels(image->height - 1 - row, 0, width, &scratch[0]);
+        unsigned char* out = &raw[scanlineSize * (row - rowStart)];
+
+        // filter type 1 (Sub): each byte is stored as the difference
+        // to the same channel of the pixel on its left
+        out[0] = 1;
+        unsigned char prev[3] = { 0, 0, 0 };
+        for (int i=0; i<width; i++) {
+            for (int c=0; c<3; c++) {
+                unsigned char val = static_cast<unsigned char>(255.f * CLAMP(ptr[c], 0.f, 1.f));
+                out[1 + 3*i + c] = static_cast<unsigned char>(val - prev[c]);
+                prev[c] = val;
+            }
+            ptr += 4;
+        }
+    }
+
+    band.rawSize = raw.size();
+    band.adler = adler32(adler32(0L, Z_NULL, 0), &raw[0], static_cast<uInt>(raw.size()));
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, PNG_COMPRESSION_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+    band.compressed.resize(deflateBound(&stream, raw.size()) + 16);
+    stream.next_in = &raw[0];
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = &band.compressed[0];
+    stream.avail_out = static_cast<uInt>(band.compressed.size());
+
+    deflate(&stream, lastBand ? Z_FINISH : Z_SYNC_FLUSH);
+
+    band.compressed.resize(band.compressed.size() - stream.avail_out);
+    deflateEnd(&stream);
+}
+
+// writePNGImage --
+//
+// assumes input pixels are float4
+// write 3-channel 8-bit png, compressing bands of rows in parallel.
+// Returns the number of bytes written.
+size_t
+writePNGImage(const Image* image, const char *filename)
+{
+    FILE *fp = fopen(filename, "wb");
+
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s for write\n", filename);
+        exit(1);
+    }
+
+    int height = image->height;
+    int numBands = std::max(1, std::min(numWorkerThreads(), height / MIN_ROWS_PER_BAND));
+    int rowsPerBand = (height + numBands - 1) / numBands;
+    numBands = (height + rowsPerBand - 1) / rowsPerBand;
+
+    std::vector<PNGBand> bands(numBands);
+
+    parallelFor(0, numBands, 1, [&](int begin, int end) {
+        for (int b=begin; b<end; b++) {
+            int rowStart = b * rowsPerBand;
+            int rowEnd = std::min(height, rowStart + rowsPerBand);
+            compressBand(image, rowStart, rowEnd, b == numBands - 1, bands[b]);
+        }
+    });
+
+    size_t bytesWritten = 0;
+
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    fwrite(signature, 1, sizeof(signature), fp);
+    bytesWritten += sizeof(signature);
+
+    // IHDR: width, height, bit depth 8, color type 2 (RGB), default
+    // compression and filter methods, no interlacing
+    std::vector<unsigned char> ihdr;
+    putBigEndian32(ihdr, image->width);
+    putBigEndian32(ihdr, height);
+    ihdr.push_back(8);
+    ihdr.push_back(2);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    bytesWritten += writeChunk(fp, "IHDR", &ihdr[0], ihdr.size());
+
+    // The image data is a single zlib stream split over one IDAT chunk
+    // per band: zlib header in front of the first band, and the adler32
+    // of the whole stream (combined from the bands) after the last.
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (int b=0; b<numBands; b++) {
+
+        std::vector<unsigned char>& data = bands[b].compressed;
+        adler = adler32_combine(adler, bands[b].adler, bands[b].rawSize);
+
+        if (b == 0) {
+            static const unsigned char zlibHeader[2] = { 0x78, 0x01 };
+            data.insert(data.begin(), zlibHeader, zlibHeader + 2);
+        }
+        if (b == numBands - 1)
+            putBigEndian32(data, static_cast<unsigned int>(adler));
+
+        bytesWritten += writeChunk(fp, "IDAT", &data[0], data.size());
+    }
+
+    bytesWritten += writeChunk(fp, "IEND", NULL, 0);
+
+    fclose(fp);
+    printf("Wrote image file %s\n", filename);
+
+    return bytesWritten;
+}
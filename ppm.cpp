@@ -2,8 +2,11 @@
 #include <stdio.h>
 #include <math.h>
 #include <algorithm>
+#include <vector>
 
 #include "image.h"
+#include "ppm.h"
+#include "trace.h"
 #include "util.h"
 
 
@@ -12,7 +15,8 @@
 //
 // assumes input pixels are float4
 // write 3-channel (8 bit --> 24 bits per pixel) ppm
-void
+// Returns the number of bytes written.
+size_t
 writePPMImage(const Image* image, const char *filename)
 {
     FILE *fp = fopen(filename, "wb");
@@ -23,14 +27,20 @@ writePPMImage(const Image* image, const char *filename)
     }
 
     // write ppm header
-    fprintf(fp, "P6\n");
-    fprintf(fp, "%d %d\n", image->width, image->height);
-    fprintf(fp, "255\n");
+    size_t bytesWritten = 0;
+    bytesWritten += fprintf(fp, "P6\n");
+    bytesWritten += fprintf(fp, "%d %d\n", image->width, image->height);
+    bytesWritten += fprintf(fp, "255\n");
+
+    std::vector<float> scratch(4 * image->width);
 
     for (int j=image->height-1; j>=0; j--) {
+
+        const float* row = image->rowPixels(j, 0, image->width, &scratch[0]);
+
         for (int i=0; i<image->width; i++) {
 
-            const float* ptr = &image->data[4 * (j*image->width + i)];
+            const float* ptr = &row[4 * i];
 
             char val[3];
             val[0] = static_cast<char>(255.f * CLAMP(ptr[0], 0.f, 1.f));
@@ -43,6 +53,37 @@ writePPMImage(const Image* image, const char *filename)
         }
     }
 
+    bytesWritten += 3 * static_cast<size_t>(image->width) * image->height;
+
     fclose(fp);
     printf("Wrote image file %s\n", filename);
+
+    return bytesWritten;
+}
+
+// writeImage --
+//
+// write the image in the requested file format
+size_t
+writeImage(const Image* image, const char *filename, ImageFormat format)
+{
+    TRACE_ZONE("encode");
+
+    if (format == IMAGE_FORMAT_PNG)
+        return writePNGImage(image, filename);
+    if (format == IMAGE_FORMAT_TILE_SEQUENCE) {
+        fprintf(stderr, "Error: a tile sequence is not a single image format\n");
+        return 0;
+    }
+    return writePPMImage(image, filename);
+}
+
+const char*
+imageFormatExtension(ImageFormat format)
+{
+    if (format == IMAGE_FORMAT_PNG)
+        return "png";
+    if (format == IMAGE_FORMAT_TILE_SEQUENCE)
+        return "tseq";
+    return "ppm";
 }
@@ -1,8 +1,24 @@
 #ifndef __PPM_H__
 #define __PPM_H__
 
+#include <stddef.h>
+
 struct Image;
 
-void writePPMImage(const Image* image, const char *filename);
+// IMAGE_FORMAT_TILE_SEQUENCE stores all the frames of a run in one
+// tile-delta sequence file (see tileSequence.h), not one file per frame
+typedef enum {
+    IMAGE_FORMAT_PPM,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_TILE_SEQUENCE
+} ImageFormat;
+
+size_t writePPMImage(const Image* image, const char *filename);
+
+size_t writePNGImage(const Image* image, const char *filename);
+
+size_t writeImage(const Image* image, const char *filename, ImageFormat format);
+
+const char* imageFormatExtension(ImageFormat format);
 
 #endif
@@ -4,8 +4,11 @@
 #include <vector>
 
 #include "refRenderer.h"
+#include "coverage.h"
 #include "image.h"
 #include "sceneLoader.h"
+#include "subPixel.h"
+#include "trace.h"
 #include "util.h"
 
 RefRenderer::RefRenderer() {
@@ -15,6 +18,9 @@ RefRenderer::RefRenderer() {
     position = NULL;
     color = NULL;
     radius = NULL;
+    ownsScene = false;
+
+    antialias = false;
 }
 
 RefRenderer::~RefRenderer() {
@@ -23,11 +29,22 @@ RefRenderer::~RefRenderer() {
         delete image;
     }
 
-    if (position) {
+    releaseScene();
+}
+
+void
+RefRenderer::releaseScene() {
+
+    if (ownsScene) {
         delete [] position;
         delete [] color;
         delete [] radius;
     }
+    numCircles = 0;
+    position = NULL;
+    color = NULL;
+    radius = NULL;
+    ownsScene = false;
 }
 
 const Image*
@@ -42,14 +59,34 @@ RefRenderer::setup() {
 
 // allocOutputImage --
 //
-// Allocate buffer the renderer will render into.  Check status of
-// image first to avoid memory leak.
-void
+// Allocate buffer the renderer will render into.  An image of the
+// right size is kept as is; otherwise the old one goes back to the
+// framebuffer pool first.  Returns false if the pool has no memory for
+// the new one.
+bool
 RefRenderer::allocOutputImage(int width, int height) {
 
+    if (image && image->ownsPixels() && image->allocatedWidth == width && image->allocatedHeight == height)
+        return setRenderResolution(width, height);
+
     if (image)
         delete image;
     image = new Image(width, height);
+    if (!image->data) {
+        delete image;
+        image = NULL;
+        return false;
+    }
+    return true;
+}
+
+// setRenderResolution --
+//
+// Render the following frames into a width x height image.  Since the
+// renderer works in normalized coordinates, nothing else changes.
+bool
+RefRenderer::setRenderResolution(int width, int height) {
+    return image && image->resize(width, height);
 }
 
 // clearImage --
@@ -59,23 +96,74 @@ RefRenderer::allocOutputImage(int width, int height) {
 void
 RefRenderer::clearImage() {
 
+    TRACE_ZONE("clear");
     image->clear(1.f, 1.f, 1.f, 1.f);
 
 }
 
+void
+RefRenderer::clearRegion(int minX, int minY, int maxX, int maxY) {
+
+    TRACE_ZONE("clear");
+    image->clearRect(minX, minY, maxX, maxY, 1.f, 1.f, 1.f, 1.f);
+}
+
 void
 RefRenderer::loadScene(SceneName scene) {
+
+    releaseScene();
+
+    float* loadedPosition;
+    float* loadedColor;
+    float* loadedRadius;
     sceneName = scene;
-    loadCircleScene(sceneName, numCircles, position, color, radius);
+    loadCircleScene(sceneName, numCircles, loadedPosition, loadedColor, loadedRadius);
+
+    position = loadedPosition;
+    color = loadedColor;
+    radius = loadedRadius;
+    ownsScene = true;
 }
 
+bool
+RefRenderer::setSceneColumns(int circles, const float* circlePosition, const float* circleColor, const float* circleRadius) {
+
+    releaseScene();
+
+    numCircles = circles;
+    position = circlePosition;
+    color = circleColor;
+    radius = circleRadius;
+    return true;
+}
+
+// setOutputBuffer --
+//
+// Renders into the caller's pixels from now on.  The previous image
+// goes back to the framebuffer pool.
+bool
+RefRenderer::setOutputBuffer(float* data, int width, int height) {
+
+    if (image)
+        delete image;
+    image = new Image(width, height, data);
+    return true;
+}
+
+
+bool
+RefRenderer::setAntialias(bool enable) {
+    antialias = enable;
+    return true;
+}
 
 // shadePixel --
 //
 // Computes the contribution of the specified circle to the
 // given pixel.  All values are provided in normalized space, where
 // the screen spans [0,2]^2.  The color/opacity of the circle is
-// computed at the pixel center.
+// computed at the pixel center.  When anti-aliasing, the opacity is
+// scaled by the fraction of the pixel covered by the circle.
 void
 RefRenderer::shadePixel(
     int circleIndex,
@@ -89,10 +177,20 @@ RefRenderer::shadePixel(
 
     float rad = radius[circleIndex];
     float maxDist = rad * rad;
-
-    // circle does not contribute to the image
-    if (pixelDist > maxDist)
+    float coverage = 1.f;
+
+    if (antialias) {
+        CoverageRing ring;
+        initCoverageRing(rad, image->width, ring);
+        coverage = ringCoverage(ring, pixelDist);
+
+        // circle does not contribute to the image
+        if (coverage <= 0.f)
+            return;
+    } else if (pixelDist > maxDist) {
+        // circle does not contribute to the image
         return;
+    }
 
     float colR, colG, colB;
     float alpha;
@@ -104,7 +202,7 @@ RefRenderer::shadePixel(
     colR = color[index3];
     colG = color[index3+1];
     colB = color[index3+2];
-    alpha = .5f;
+    alpha = .5f * coverage;
 
 
     // The following code is *very important*: it blends the
@@ -129,6 +227,23 @@ RefRenderer::shadePixel(
 
 void
 RefRenderer::render() {
+    renderRegion(0, 0, image->width, image->height);
+}
+
+// renderRegion --
+//
+// Same algorithm as a full frame, with the screen bounding box of
+// every circle clamped to the region instead of to the image.  Circles
+// whose box does not intersect the region are skipped entirely.
+void
+RefRenderer::renderRegion(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    regionMinX = CLAMP(regionMinX, 0, image->width);
+    regionMaxX = CLAMP(regionMaxX, 0, image->width);
+    regionMinY = CLAMP(regionMinY, 0, image->height);
+    regionMaxY = CLAMP(regionMaxY, 0, image->height);
+
+    TRACE_ZONE("composite");
 
     // render all circles
     for (int circleIndex=0; circleIndex<numCircles; circleIndex++) {
@@ -140,19 +255,49 @@ RefRenderer::render() {
         float pz = position[index3+2];
         float rad = radius[circleIndex];
 
+        // a circle of radius zero covers nothing
+        if (rad <= 0.f)
+            continue;
+
+        // sub-pixel circle: only the 2x2 pixels around its center can
+        // be covered, test them directly.  Every pixel whose center is
+        // in the circle is inside its bounding box, so there is no need
+        // to compute it
+        if (!antialias && isSubPixelCircle(rad, image->width, image->height)) {
+            float invWidth = 1.f / image->width;
+            float invHeight = 1.f / image->height;
+            int candidateX, candidateY;
+            subPixelCandidates(px, py, image->width, image->height, candidateX, candidateY);
+            for (int pixelY=std::max(candidateY, regionMinY); pixelY<std::min(candidateY + 2, regionMaxY); pixelY++) {
+                for (int pixelX=std::max(candidateX, regionMinX); pixelX<std::min(candidateX + 2, regionMaxX); pixelX++) {
+                    float pixelCenterNormX = invWidth * (static_cast<float>(pixelX) + 0.5f);
+                    float pixelCenterNormY = invHeight * (static_cast<float>(pixelY) + 0.5f);
+                    shadePixel(circleIndex, pixelCenterNormX, pixelCenterNormY, px, py, pz,
+                               &image->data[4 * (pixelY * image->width + pixelX)]);
+                }
+            }
+            continue;
+        }
+
         // compute the bounding box of the circle.  This bounding box
-        // is in normalized coordinates
-        float minX = px - rad;
-        float maxX = px + rad;
-        float minY = py - rad;
-        float maxY = py + rad;
+        // is in normalized coordinates.  Anti-aliased circles also
+        // partially cover the pixels just outside their edge
+        float reach = antialias ? rad + coverageReach(image->width) : rad;
+        float minX = px - reach;
+        float maxX = px + reach;
+        float minY = py - reach;
+        float maxY = py + reach;
 
         // convert normalized coordinate bounds to integer screen
-        // pixel bounds.  Clamp to the edges of the screen.
-        int screenMinX = CLAMP(static_cast<int>(minX * image->width), 0, image->width);
-        int screenMaxX = CLAMP(static_cast<int>(maxX * image->width)+1, 0, image->width);
-        int screenMinY = CLAMP(static_cast<int>(minY * image->height), 0, image->height);
-        int screenMaxY = CLAMP(static_cast<int>(maxY * image->height)+1, 0, image->height);
+        // pixel bounds.  Clamp to the edges of the region.
+        int screenMinX = CLAMP(static_cast<int>(minX * image->width), regionMinX, regionMaxX);
+        int screenMaxX = CLAMP(static_cast<int>(maxX * image->width)+1, regionMinX, regionMaxX);
+        int screenMinY = CLAMP(static_cast<int>(minY * image->height), regionMinY, regionMaxY);
+        int screenMaxY = CLAMP(static_cast<int>(maxY * image->height)+1, regionMinY, regionMaxY);
+
+        // circle is outside of the region
+        if (screenMinX >= screenMaxX || screenMinY >= screenMaxY)
+            continue;
 
         float invWidth = 1.f / image->width;
         float invHeight = 1.f / image->height;
@@ -12,9 +12,15 @@ private:
     SceneName sceneName;
 
     int numCircles;
-    float* position;
-    float* color;
-    float* radius;
+    const float* position;
+    const float* color;
+    const float* radius;
+    // false when the circle columns belong to the caller
+    bool ownsScene;
+
+    bool antialias;
+
+    void releaseScene();
 
 public:
 
@@ -27,12 +33,24 @@ public:
 
     void loadScene(SceneName name);
 
-    void allocOutputImage(int width, int height);
+    bool allocOutputImage(int width, int height);
+
+    bool setRenderResolution(int width, int height);
 
     void clearImage();
 
+    void clearRegion(int minX, int minY, int maxX, int maxY);
+
     void render();
 
+    void renderRegion(int minX, int minY, int maxX, int maxY);
+
+    bool setAntialias(bool enable);
+
+    bool setSceneColumns(int numCircles, const float* position, const float* color, const float* radius);
+
+    bool setOutputBuffer(float* data, int width, int height);
+
     void dumpParticles(const char* filename);
 
     void shadePixel(
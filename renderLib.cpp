@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "renderLib.h"
+#include "circleRenderer.h"
+#include "depthSort.h"
+#include "image.h"
+#include "parallel.h"
+#include "refRenderer.h"
+#include "tiledRenderer.h"
+#include "util.h"
+
+// rows converted by each parallelFor chunk when filling a target
+#define CONVERT_CHUNK_ROWS 32
+
+struct CRRenderer {
+    CircleRenderer* renderer;
+    bool hasScene;
+    bool setUp;
+
+    // the target the renderer draws into directly, if any
+    float* directPixels;
+    int width;
+    int height;
+
+    // depth ordered copy of a scene given out of order
+    std::vector<float> sortedPosition;
+    std::vector<float> sortedColor;
+    std::vector<float> sortedRadius;
+};
+
+
+// isDirectTarget --
+//
+// Targets laid out like the renderers' own images are rendered into
+// without any conversion.
+static bool
+isDirectTarget(const CRTarget* target) {
+    return target->format == CR_FORMAT_RGBA32F && target->bottomUp &&
+           target->stride == sizeof(float) * 4 * target->width &&
+           reinterpret_cast<uintptr_t>(target->pixels) % sizeof(float) == 0;
+}
+
+static size_t
+formatPixelBytes(CRPixelFormat format) {
+    switch (format) {
+    case CR_FORMAT_RGBA32F: return 4 * sizeof(float);
+    case CR_FORMAT_RGBA8:   return 4;
+    case CR_FORMAT_BGRA8:   return 4;
+    case CR_FORMAT_RGB8:    return 3;
+    default:                return 0;
+    }
+}
+
+static unsigned char
+toByte(float value) {
+    return static_cast<unsigned char>(255.f * CLAMP(value, 0.f, 1.f));
+}
+
+// fillTarget --
+//
+// Converts the pixels of [minX, maxX) x [minY, maxY) of the image
+// into the target, rows in parallel.
+static void
+fillTarget(const Image* image, const CRTarget* target, int minX, int minY, int maxX, int maxY) {
+
+    parallelFor(minY, maxY, CONVERT_CHUNK_ROWS, [&](int begin, int end) {
+        std::vector<float> scratch(4 * (maxX - minX));
+        for (int y=begin; y<end; y++) {
+
+            const float* src = image->rowPixels(y, minX, maxX, &scratch[0]);
+            int row = target->bottomUp ? y : target->height - 1 - y;
+            unsigned char* dst = static_cast<unsigned char*>(target->pixels) + row * target->stride +
+                                 minX * formatPixelBytes(target->format);
+            int count = maxX - minX;
+
+            switch (target->format) {
+            case CR_FORMAT_RGBA32F:
+                memcpy(dst, src, sizeof(float) * 4 * count);
+                break;
+            case CR_FORMAT_RGBA8:
+                for (int i=0; i<count; i++, src+=4, dst+=4) {
+                    dst[0] = toByte(src[0]);
+                    dst[1] = toByte(src[1]);
+                    dst[2] = toByte(src[2]);
+                    dst[3] = toByte(src[3]);
+                }
+                break;
+            case CR_FORMAT_BGRA8:
+                for (int i=0; i<count; i++, src+=4, dst+=4) {
+                    dst[0] = toByte(src[2]);
+                    dst[1] = toByte(src[1]);
+                    dst[2] = toByte(src[0]);
+                    dst[3] = toByte(src[3]);
+                }
+                break;
+            case CR_FORMAT_RGB8:
+                for (int i=0; i<count; i++, src+=4, dst+=3) {
+                    dst[0] = toByte(src[0]);
+                    dst[1] = toByte(src[1]);
+                    dst[2] = toByte(src[2]);
+                }
+                break;
+            }
+        }
+    });
+}
+
+// clearRect --
+//
+// White, opaque [minX, maxX) x [minY, maxY) of RGBA float pixels, like
+// clearImage() does for a whole image.
+static void
+clearRect(float* pixels, int width, int minX, int minY, int maxX, int maxY) {
+
+    for (int y=minY; y<maxY; y++) {
+        float* ptr = &pixels[4 * (y * width + minX)];
+        std::fill(ptr, ptr + 4 * (maxX - minX), 1.f);
+    }
+}
+
+
+int
+crApiVersion(void) {
+    return CR_API_VERSION;
+}
+
+const char*
+crStatusString(CRStatus status) {
+    switch (status) {
+    case CR_OK:                     return "ok";
+    case CR_ERROR_INVALID_ARGUMENT: return "invalid argument";
+    case CR_ERROR_NO_SCENE:         return "no scene set";
+    case CR_ERROR_UNSUPPORTED:      return "not supported by this renderer";
+    case CR_ERROR_OUT_OF_MEMORY:    return "out of memory";
+    default:                        return "unknown status";
+    }
+}
+
+CRRenderer*
+crCreateRenderer(CRRendererType type, const CROptions* options) {
+
+    CROptions defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    if (!options)
+        options = &defaults;
+
+    if (options->numThreads < 0 || options->tileSize < 0)
+        return NULL;
+
+    CircleRenderer* renderer;
+    if (type == CR_RENDERER_TILED) {
+        TiledRenderer* tiledRenderer = new TiledRenderer();
+        tiledRenderer->setNumThreads(options->numThreads);
+        if (options->tileSize > 0)
+            tiledRenderer->setTileSize(options->tileSize);
+        tiledRenderer->setCompactScene(options->compact != 0);
+        renderer = tiledRenderer;
+    } else if (type == CR_RENDERER_REF && !options->compact) {
+        renderer = new RefRenderer();
+    } else {
+        return NULL;
+    }
+    renderer->setAntialias(options->antialias != 0);
+
+    CRRenderer* handle = new CRRenderer;
+    handle->renderer = renderer;
+    handle->hasScene = false;
+    handle->setUp = false;
+    handle->directPixels = NULL;
+    handle->width = 0;
+    handle->height = 0;
+    return handle;
+}
+
+void
+crDestroyRenderer(CRRenderer* renderer) {
+
+    if (!renderer)
+        return;
+    delete renderer->renderer;
+    delete renderer;
+}
+
+CRStatus
+crSetScene(CRRenderer* renderer, int numCircles,
+           const float* position, const float* color, const float* radius) {
+
+    if (!renderer || numCircles < 0 || (numCircles > 0 && (!position || !color || !radius)))
+        return CR_ERROR_INVALID_ARGUMENT;
+
+    if (circlesInDepthOrder(numCircles, position)) {
+        std::vector<float>().swap(renderer->sortedPosition);
+        std::vector<float>().swap(renderer->sortedColor);
+        std::vector<float>().swap(renderer->sortedRadius);
+    } else {
+        renderer->sortedPosition.assign(position, position + 3 * numCircles);
+        renderer->sortedColor.assign(color, color + 3 * numCircles);
+        renderer->sortedRadius.assign(radius, radius + numCircles);
+        sortCirclesByDepth(numCircles, &renderer->sortedPosition[0], &renderer->sortedColor[0],
+                           &renderer->sortedRadius[0]);
+        position = &renderer->sortedPosition[0];
+        color = &renderer->sortedColor[0];
+        radius = &renderer->sortedRadius[0];
+    }
+
+    if (!renderer->renderer->setSceneColumns(numCircles, position, color, radius))
+        return CR_ERROR_UNSUPPORTED;
+    renderer->hasScene = true;
+    return CR_OK;
+}
+
+CRStatus
+crRenderRegion(CRRenderer* renderer, const CRTarget* target,
+               int minX, int minY, int maxX, int maxY) {
+
+    if (!renderer || !target || !target->pixels || target->width <= 0 || target->height <= 0 ||
+        formatPixelBytes(target->format) == 0 ||
+        target->stride < formatPixelBytes(target->format) * target->width)
+        return CR_ERROR_INVALID_ARGUMENT;
+    if (!renderer->hasScene)
+        return CR_ERROR_NO_SCENE;
+
+    minX = CLAMP(minX, 0, target->width);
+    maxX = CLAMP(maxX, 0, target->width);
+    minY = CLAMP(minY, 0, target->height);
+    maxY = CLAMP(maxY, 0, target->height);
+    if (minX >= maxX || minY >= maxY)
+        return CR_OK;
+
+    CircleRenderer* circleRenderer = renderer->renderer;
+    bool direct = isDirectTarget(target);
+    float* directPixels = direct ? static_cast<float*>(target->pixels) : NULL;
+
+    // a new target: render into it, or into an image of the renderer's
+    // own (reused from the framebuffer pool when the size repeats)
+    if (directPixels != renderer->directPixels || target->width != renderer->width ||
+        target->height != renderer->height || !renderer->setUp) {
+        if (direct)
+            circleRenderer->setOutputBuffer(directPixels, target->width, target->height);
+        else if (!circleRenderer->allocOutputImage(target->width, target->height)) {
+            renderer->width = 0;
+            renderer->height = 0;
+            return CR_ERROR_OUT_OF_MEMORY;
+        }
+        renderer->directPixels = directPixels;
+        renderer->width = target->width;
+        renderer->height = target->height;
+    }
+
+    if (!renderer->setUp) {
+        circleRenderer->setup();
+        renderer->setUp = true;
+    }
+
+    // setup() allocates the image again when the tile size changed,
+    // the next call then starts over with a new image
+    if (!circleRenderer->getImage()) {
+        renderer->width = 0;
+        renderer->height = 0;
+        return CR_ERROR_OUT_OF_MEMORY;
+    }
+
+    bool fullFrame = minX == 0 && minY == 0 && maxX == target->width && maxY == target->height;
+
+    // the pixels of a direct target outside the region belong to the
+    // caller, only the region is cleared
+    if (fullFrame || !direct)
+        circleRenderer->clearImage();
+    else
+        clearRect(directPixels, target->width, minX, minY, maxX, maxY);
+
+    if (fullFrame)
+        circleRenderer->render();
+    else
+        circleRenderer->renderRegion(minX, minY, maxX, maxY);
+
+    if (!direct)
+        fillTarget(circleRenderer->getImage(), target, minX, minY, maxX, maxY);
+
+    return CR_OK;
+}
+
+CRStatus
+crRender(CRRenderer* renderer, const CRTarget* target) {
+
+    if (!target)
+        return CR_ERROR_INVALID_ARGUMENT;
+    return crRenderRegion(renderer, target, 0, 0, target->width, target->height);
+}
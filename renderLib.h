@@ -0,0 +1,119 @@
+#ifndef __RENDER_LIB_H__
+#define __RENDER_LIB_H__
+
+// Embeddable circle renderer (librender.a, built with make lib).
+//
+// A plain C interface over the CPU renderers, for programs that want
+// frames in their own memory rather than PPM files:
+//
+//   CRRenderer* renderer = crCreateRenderer(CR_RENDERER_TILED, NULL);
+//   crSetScene(renderer, numCircles, position, color, radius);
+//
+//   CRTarget target = { pixels, width, height, width * 4, CR_FORMAT_RGBA8, 0 };
+//   crRender(renderer, &target);
+//   ...
+//   crDestroyRenderer(renderer);
+//
+// The library never writes to stdout or stderr; errors are reported
+// through the returned status.  Renderers are independent of each
+// other (each tiled renderer has its own threads), so several of them
+// can be used at the same time, from different threads.  A single
+// renderer must not be used from two threads at once.
+//
+// The CUDA renderer is not part of the library: its scene and image
+// parameters live in process-wide device constants.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CR_API_VERSION 1
+
+typedef struct CRRenderer CRRenderer;
+
+typedef enum {
+    CR_RENDERER_REF,        // sequential reference renderer
+    CR_RENDERER_TILED       // multithreaded tiled renderer
+} CRRendererType;
+
+typedef enum {
+    CR_OK = 0,
+    CR_ERROR_INVALID_ARGUMENT,
+    CR_ERROR_NO_SCENE,
+    CR_ERROR_UNSUPPORTED,
+    CR_ERROR_OUT_OF_MEMORY  // no memory for the renderer's own image
+} CRStatus;
+
+// pixel formats of a target.  Colors are in [0, 1], clamped and scaled
+// to [0, 255] for the 8-bit formats (same conversion as the PPM files)
+typedef enum {
+    CR_FORMAT_RGBA32F,      // 4 floats per pixel
+    CR_FORMAT_RGBA8,
+    CR_FORMAT_BGRA8,
+    CR_FORMAT_RGB8
+} CRPixelFormat;
+
+// CRTarget --
+//
+// Caller-owned destination of a frame.  stride is the distance in bytes
+// between the starts of two consecutive rows.  Rows are stored top row
+// first unless bottomUp is set.  An RGBA32F target with bottomUp set
+// and no row padding is rendered into directly; any other target is
+// filled from the renderer's own float image once the frame is done.
+typedef struct {
+    void* pixels;
+    int width;
+    int height;
+    size_t stride;
+    CRPixelFormat format;
+    int bottomUp;
+} CRTarget;
+
+// CROptions --
+//
+// Renderer settings, zero for the defaults.
+typedef struct {
+    int numThreads;         // tiled renderer threads, 0: all hardware threads
+    int tileSize;           // tiled renderer tile edge, 0: 32 pixels
+    int antialias;          // shade with the analytic pixel coverage
+    int compact;            // tiled renderer: quantized circle storage
+} CROptions;
+
+int crApiVersion(void);
+
+const char* crStatusString(CRStatus status);
+
+// Returns NULL if the type or the options are invalid.  options may be
+// NULL.
+CRRenderer* crCreateRenderer(CRRendererType type, const CROptions* options);
+
+void crDestroyRenderer(CRRenderer* renderer);
+
+// Renders the given circles from now on, in depth order (first circle
+// farthest).  position holds x, y, z and color r, g, b per circle, in
+// normalized [0, 1] image coordinates and colors.  The arrays are
+// borrowed, not copied: they must stay valid and unchanged until the
+// next crSetScene or crDestroyRenderer.  Circles given out of depth
+// order are rendered from a sorted copy instead (circles of equal depth
+// keep their order), made once here.
+CRStatus crSetScene(CRRenderer* renderer, int numCircles,
+                    const float* position, const float* color, const float* radius);
+
+// Clears the target to white and renders the scene into it.  Targets
+// that are not rendered into directly go through an image of the
+// renderer's own; CR_ERROR_OUT_OF_MEMORY if it cannot be allocated.
+CRStatus crRender(CRRenderer* renderer, const CRTarget* target);
+
+// Same, but only the pixels in [minX, maxX) x [minY, maxY) (counted
+// from the bottom left corner, like the renderers' own images) are
+// rendered and written to the target; the others are left untouched.
+CRStatus crRenderRegion(CRRenderer* renderer, const CRTarget* target,
+                        int minX, int minY, int maxX, int maxY);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
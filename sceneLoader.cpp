@@ -6,128 +6,220 @@
 #include <functional>
 
 #include "sceneLoader.h"
+#include "counterRng.h"
+#include "parallel.h"
+#include "trace.h"
 #include "util.h"
 
+// Every random attribute of a circle is drawn from the counter-based
+// generator in counterRng.h, keyed by the circle's index.  Each
+// attribute uses its own stream so that adding an attribute never
+// changes the value of the others.
+enum {
+    STREAM_DEPTH = 0,
+    STREAM_RADIUS,
+    STREAM_POS_X,
+    STREAM_POS_Y,
+    STREAM_COLOR_R,
+    STREAM_COLOR_G,
+    STREAM_COLOR_B
+};
+
+// Below this many circles a scene is generated on the calling thread
+static const int PARALLEL_GENERATE_CHUNK = 16 * 1024;
+
 // randomFloat --
-// //
-// // return a random floating point value between 0 and 1
-static float
-randomFloat() {
-    return static_cast<float>(rand()) / RAND_MAX;
+//
+// return a random floating point value between 0 and 1 for the given
+// circle index and attribute stream
+static inline float
+randomFloat(uint64_t seed, int index, int stream) {
+    return counterRandomFloat(seed, static_cast<uint64_t>(index), stream);
+}
+
+// sortedDepth --
+//
+// Depths must be decreasing with the circle index (farthest circle is
+// drawn first).  Instead of drawing numCircles uniform values and
+// sorting them, split [0,1] into numCircles equal strata in decreasing
+// order and jitter each circle's depth within its own stratum.  The
+// result is a uniformly distributed, strictly decreasing sequence in
+// which the depth of any circle can be computed on its own.
+static inline float
+sortedDepth(uint64_t seed, int index, int numCircles) {
+    double jitter = randomFloat(seed, index, STREAM_DEPTH);
+    return static_cast<float>(1.0 - (static_cast<double>(index) + jitter) / numCircles);
+}
+
+// randomColor --
+//
+// Circle colors of the random scenes.  The palette depends on the
+// total number of circles in the scene.
+static inline void
+randomColor(uint64_t seed, int index, int numCircles, float* color) {
+
+    float r = randomFloat(seed, index, STREAM_COLOR_R);
+    float g = randomFloat(seed, index, STREAM_COLOR_G);
+    float b = randomFloat(seed, index, STREAM_COLOR_B);
+
+    if (numCircles <= 10000) {
+        color[0] = .1f + .9f * r;
+        color[1] = .2f + .5f * g;
+        color[2] = .5f + .5f * b;
+    } else {
+        color[0] = .3f + .9f * r;
+        color[1] = .1f + .9f * g;
+        color[2] = .1f + .4f * b;
+    }
 }
 
+// Fixed test scenes: position (x, y, depth), color (r, g, b) and radius
+// of each circle, farthest first.
+
+static const float RGB_POSITION[] = { .4f, .5f, .75f,   .5f, .5f, .5f,   .6f, .5f, .25f };
+static const float RGB_COLOR[]    = { 1.f, 0.f, 0.f,    0.f, 1.f, 0.f,   0.f, 0.f, 1.f };
+static const float RGB_RADIUS[]   = { .3f, .3f, .3f };
+
+static const float RGBY_POSITION[] = { .25f, .25f, .75f,   .3f, .3f, .5f,   .5f, .5f, .25f,   .2f, .2f, .9f };
+static const float RGBY_COLOR[]    = { 1.f, 0.f, 0.f,      0.f, 1.f, 0.f,   0.f, 0.f, 1.f,    1.f, 1.f, 0.f };
+static const float RGBY_RADIUS[]   = { .19f, .19f, .25f, .1f };
+
+// the pattern scene is two overlapping grids of circles
+static const int PATTERN_GRID1 = 16;
+static const int PATTERN_GRID2 = 31;
+
 static void
-makeCircleGrid(
+copyFixedCircles(
+    const float* srcPosition,
+    const float* srcColor,
+    const float* srcRadius,
     int startIndex,
-    int circleCount,
-    float circleRadius,
-    float circleColor[3],
-    float startOffsetX,
-    float startOffsetY,
+    int count,
     float* position,
     float* color,
     float* radius)
 {
+    for (int i=0; i<count; i++) {
+        int src = startIndex + i;
+        for (int c=0; c<3; c++) {
+            position[3*i+c] = srcPosition[3*src+c];
+            color[3*i+c] = srcColor[3*src+c];
+        }
+        radius[i] = srcRadius[src];
+    }
+}
+
+// makePatternCircles --
+//
+// Generates circles [startIndex, startIndex+count) of the pattern
+// scene.  Circle index determines the grid and the cell in the grid.
+static void
+makePatternCircles(
+    uint64_t seed,
+    int startIndex,
+    int count,
+    float* position,
+    float* color,
+    float* radius)
+{
+    float circleRadius = .5f * (1.f / PATTERN_GRID1);
+
+    for (int i=0; i<count; i++) {
+
+        int index = startIndex + i;
+        int gridIndex = index;
+        int circleCount = PATTERN_GRID1;
+        float startOffset = circleRadius;
+        float circleColor[3] = { 1.f, 0.f, 0.f };
 
-    int index = startIndex;
-    for (int j=0; j<circleCount; j++) {
-        for (int i=0; i<circleCount; i++) {
-            int index3 = 3 * index;
-            float x = startOffsetX + (2.f * circleRadius * i);
-            float y = startOffsetY + (2.f * circleRadius * j);
-            position[index3] = x;
-            position[index3+1] = y;
-            position[index3+2] = randomFloat();
-            color[index3] = circleColor[0];
-            color[index3+1] = circleColor[1];
-            color[index3+2] = circleColor[2];
-            radius[index] =  circleRadius;
-            index++;
+        if (gridIndex >= PATTERN_GRID1 * PATTERN_GRID1) {
+            gridIndex -= PATTERN_GRID1 * PATTERN_GRID1;
+            circleCount = PATTERN_GRID2;
+            startOffset = 0.f;
+            circleColor[1] = 1.f;
         }
+
+        int cellX = gridIndex % circleCount;
+        int cellY = gridIndex / circleCount;
+
+        int index3 = 3 * i;
+        position[index3] = startOffset + (2.f * circleRadius * cellX);
+        position[index3+1] = startOffset + (2.f * circleRadius * cellY);
+        position[index3+2] = randomFloat(seed, index, STREAM_DEPTH);
+        color[index3] = circleColor[0];
+        color[index3+1] = circleColor[1];
+        color[index3+2] = circleColor[2];
+        radius[i] = circleRadius;
     }
 }
 
+// generateRandomCircles --
+//
+// Generates circles [startIndex, startIndex+count) of a scene of
+// numCircles randomly placed circles.  The output arrays hold count
+// circles.  Circles are independent of each other, so the range is
+// split across worker threads.
 static void
 generateRandomCircles(
+    uint64_t seed,
     int numCircles,
+    int startIndex,
+    int count,
     float* position,
     float* color,
     float* radius) {
 
-    srand(0);
-    std::vector<float> depths(numCircles);
-    for (int i=0; i<numCircles; i++) {
-        depths[i] = randomFloat();
-    }
+    parallelFor(0, count, PARALLEL_GENERATE_CHUNK, [&](int begin, int end) {
+        for (int i=begin; i<end; i++) {
 
-    std::sort(depths.begin(), depths.end(),  std::greater<float>());
+            int index = startIndex + i;
+            int index3 = 3 * i;
 
-    for (int i=0; i<numCircles; i++) {
-
-        float depth = depths[i];
+            radius[i] = .02f + .06f * randomFloat(seed, index, STREAM_RADIUS);
 
-        radius[i] = .02f + .06f * randomFloat();
+            position[index3] = randomFloat(seed, index, STREAM_POS_X);
+            position[index3+1] = randomFloat(seed, index, STREAM_POS_Y);
+            position[index3+2] = sortedDepth(seed, index, numCircles);
 
-        int index3 = 3 * i;
-
-        position[index3] = randomFloat();
-        position[index3+1] = randomFloat();
-        position[index3+2] = depth;
-
-        if (numCircles <= 10000) {
-            color[index3] = .1f + .9f * randomFloat();
-            color[index3+1] = .2f + .5f * randomFloat();
-            color[index3+2] = .5f + .5f * randomFloat();
-        } else {
-            color[index3] = .3f + .9f * randomFloat();
-            color[index3+1] = .1f + .9f * randomFloat();
-            color[index3+2] = .1f + .4f * randomFloat();
+            randomColor(seed, index, numCircles, &color[index3]);
         }
-    }
+    });
 }
 
+// generateSizeCircles --
+//
+// Same as generateRandomCircles, but all circles have radius targetR
 static void
 generateSizeCircles(
+    uint64_t seed,
     int numCircles,
+    int startIndex,
+    int count,
     float* position,
     float* color,
     float* radius,
     float targetR) {
 
-    srand(0);
-    std::vector<float> depths(numCircles);
-    for (int i=0; i<numCircles; i++) {
-        depths[i] = randomFloat();
-    }
-
-    std::sort(depths.begin(), depths.end(),  std::greater<float>());
+    parallelFor(0, count, PARALLEL_GENERATE_CHUNK, [&](int begin, int end) {
+        for (int i=begin; i<end; i++) {
 
-    for (int i=0; i<numCircles; i++) {
+            int index = startIndex + i;
+            int index3 = 3 * i;
 
-        float depth = depths[i];
+            radius[i] = targetR;
 
-        radius[i] = targetR;
+            position[index3] = randomFloat(seed, index, STREAM_POS_X);
+            position[index3+1] = randomFloat(seed, index, STREAM_POS_Y);
+            position[index3+2] = sortedDepth(seed, index, numCircles);
 
-        int index3 = 3 * i;
-
-        position[index3] = randomFloat(); //targetR + (1.f - targetR) * randomFloat();
-        position[index3+1] = randomFloat(); //targetR + (1.f - targetR) * randomFloat();
-        position[index3+2] = depth;
-
-        if (numCircles <= 10000) {
-            color[index3] = .1f + .9f * randomFloat();
-            color[index3+1] = .2f + .5f * randomFloat();
-            color[index3+2] = .5f + .5f * randomFloat();
-        } else {
-            color[index3] = .3f + .9f * randomFloat();
-            color[index3+1] = .1f + .9f * randomFloat();
-            color[index3+2] = .1f + .4f * randomFloat();
+            randomColor(seed, index, numCircles, &color[index3]);
         }
-    }
+    });
 }
 
 static void
 changeCircles(
+    uint64_t seed,
     int numCircles,
     float* position,
     float* radius,
@@ -142,157 +234,109 @@ changeCircles(
 
         int index3 = 3 * i;
 
-        position[index3] = .9f - center + div * randomFloat();
-        position[index3+1] = center + div * randomFloat();
+        position[index3] = .9f - center + div * randomFloat(seed, i, STREAM_POS_X);
+        position[index3+1] = center + div * randomFloat(seed, i, STREAM_POS_Y);
     }
 }
 
-void
-loadCircleScene(
+// sceneCircleCount --
+//
+// Number of circles in the given scene, or -1 for an unknown scene
+int
+sceneCircleCount(SceneName sceneName) {
+
+    switch (sceneName) {
+    case CIRCLE_RGB:
+        return 3;
+    case CIRCLE_RGBY:
+        return 4;
+    case CIRCLE_TEST_10K:
+        return 10 * 1000;
+    case CIRCLE_TEST_100K:
+        return 100 * 1000;
+    case PATTERN:
+        return PATTERN_GRID1 * PATTERN_GRID1 + PATTERN_GRID2 * PATTERN_GRID2;
+    }
+    return -1;
+}
+
+// generateCircleRange --
+//
+// Generates circles [startIndex, startIndex+count) of the given scene
+// into position (3*count floats), color (3*count floats) and radius
+// (count floats).  The result is identical to the same range of the
+// arrays built by loadCircleScene, so large scenes can be streamed or
+// generated in independent slices.  Returns false if the scene is
+// unknown or the range is out of bounds.
+bool
+generateCircleRange(
     SceneName sceneName,
-    int& numCircles,
-    float*& position,
-    float*& color,
-    float*& radius)
+    int startIndex,
+    int count,
+    float* position,
+    float* color,
+    float* radius,
+    uint64_t seed)
 {
+    int numCircles = sceneCircleCount(sceneName);
 
-	if (sceneName == CIRCLE_RGB) {
+    if (numCircles < 0 || startIndex < 0 || count < 0 || startIndex + count > numCircles)
+        return false;
+
+    if (sceneName == CIRCLE_RGB) {
 
         // simple test scene containing 3 circles. All circles have
         // 50% opacity
         //
         // farthest circle is red.  Middle is green.  Closest is blue.
-
-        numCircles = 3;
-
-        position = new float[3 * numCircles];
-        color = new float[3 * numCircles];
-        radius = new float[numCircles];
-
-        for (int i=0; i<numCircles; i++)
-            radius[i] = .3f;
-
-        position[0] = .4f;
-        position[1] = .5f;
-        position[2] = .75f;
-        color[0] = 1.f;
-        color[1] = 0.f;
-        color[2] = 0.f;
-
-        position[3] = .5f;
-        position[4] = .5f;
-        position[5] = .5f;
-        color[3] = 0.f;
-        color[4] = 1.f;
-        color[5] = 0.f;
-
-        position[6] = .6f;
-        position[7] = .5f;
-        position[8] = .25f;
-        color[6] = 0.f;
-        color[7] = 0.f;
-        color[8] = 1.f;
+        copyFixedCircles(RGB_POSITION, RGB_COLOR, RGB_RADIUS, startIndex, count, position, color, radius);
 
     } else if (sceneName == CIRCLE_RGBY) {
 
         // Another simple test scene containing 4 circles
+        copyFixedCircles(RGBY_POSITION, RGBY_COLOR, RGBY_RADIUS, startIndex, count, position, color, radius);
 
-        numCircles = 4;
-
-        position = new float[3 * numCircles];
-        color = new float[3 * numCircles];
-        radius = new float[numCircles];
-
-        const float TINY_RADIUS = .1f;
-        const float SMALL_RADIUS = .19f;
-        const float BIG_RADIUS = .25f;
-
-        radius[0] = SMALL_RADIUS;
-        radius[1] = SMALL_RADIUS;
-        radius[2] = BIG_RADIUS;
-        radius[3] = TINY_RADIUS;
-
-        position[0] = .25f;
-        position[1] = .25f;
-        position[2] = .75f;
-        color[0] = 1.f;
-        color[1] = 0.f;
-        color[2] = 0.f;
+    } else if (sceneName == CIRCLE_TEST_10K || sceneName == CIRCLE_TEST_100K) {
 
-        position[3] = .3f;
-        position[4] = .3f;
-        position[5] = .5f;
-        color[3] = 0.f;
-        color[4] = 1.f;
-        color[5] = 0.f;
+        // test scenes containing 10K or 100K randomly placed circles
+        generateRandomCircles(seed, numCircles, startIndex, count, position, color, radius);
 
-        position[6] = .5f;
-        position[7] = .5f;
-        position[8] = .25f;
-        color[6] = 0.f;
-        color[7] = 0.f;
-        color[8] = 1.f;
-
-        position[9] = .2f;
-        position[10] = .2f;
-        position[11] = .9f;
-        color[9] = 1.f;
-        color[10] = 1.f;
-        color[11] = 0.f;
-
-    } else if (sceneName == CIRCLE_TEST_10K) {
-
-        // test scene containing 10K randomly placed circles
-
-        numCircles = 10 * 1000;
-
-        position = new float[3 * numCircles];
-        color = new float[3 * numCircles];
-        radius = new float[numCircles];
-
-        generateRandomCircles(numCircles, position, color, radius);
-
-    } else if (sceneName == CIRCLE_TEST_100K) {
-
-        // test scene containing 100K randomly placed circles
+    } else if (sceneName == PATTERN) {
 
-        numCircles = 100 * 1000;
+        makePatternCircles(seed, startIndex, count, position, color, radius);
+    }
 
-        position = new float[3 * numCircles];
-        color = new float[3 * numCircles];
-        radius = new float[numCircles];
+    return true;
+}
 
-        generateRandomCircles(numCircles, position, color, radius);
+// loadCircleScene --
+//
+// Allocates (with new[]) and generates the circles of a built-in
+// scene.  Nothing is printed, reporting the scene is up to the caller.
+void
+loadCircleScene(
+    SceneName sceneName,
+    int& numCircles,
+    float*& position,
+    float*& color,
+    float*& radius)
+{
+    TRACE_ZONE("load scene");
 
-    } else if (sceneName == PATTERN) {
+    numCircles = sceneCircleCount(sceneName);
 
-        int circleCount1 = 16;
-        int circleCount2 = 31;
-        numCircles = circleCount1 * circleCount1;
-        numCircles += circleCount2 * circleCount2;
-
-        position = new float[3 * numCircles];
-        color = new float[3 * numCircles];
-        radius = new float[numCircles];
-
-        int startIndex = 0;
-        float circleRadius = .5f * (1.f / circleCount1);
-        float startOffsetX = circleRadius;
-        float startOffsetY = circleRadius;
-        float circleColor[3];
-
-        circleColor[0] = 1.f; circleColor[1] = 0.f; circleColor[2] = 0.f;
-        makeCircleGrid(startIndex, circleCount1, circleRadius, circleColor, startOffsetX, startOffsetY, position, color, radius);
-
-        startIndex += circleCount1 * circleCount1;
-        startOffsetX = 0.f;
-        startOffsetY = 0.f;
-        circleColor[0] = 1.f; circleColor[1] = 1.f; circleColor[2] = .0f;
-        makeCircleGrid(startIndex, circleCount2, circleRadius, circleColor, startOffsetX, startOffsetY, position, color, radius);
-    } else {
-        fprintf(stderr, "Error: cann't load scene (unknown scene)\n");
+    // unknown scene: an empty one
+    if (numCircles < 0) {
+        numCircles = 0;
+        position = NULL;
+        color = NULL;
+        radius = NULL;
         return;
     }
 
-    printf("Loaded scene with %d circles\n", numCircles);
+    position = new float[3 * numCircles];
+    color = new float[3 * numCircles];
+    radius = new float[numCircles];
+
+    generateCircleRange(sceneName, 0, numCircles, position, color, radius);
 }
@@ -1,8 +1,13 @@
 #ifndef __SCENE_LOADER_H__
 #define __SCENE_LOADER_H__
 
+#include <stdint.h>
+
 #include "circleRenderer.h"
 
+// seed used by loadCircleScene for the randomly generated scenes
+#define DEFAULT_SCENE_SEED 0
+
 void
 loadCircleScene(
     SceneName sceneName,
@@ -11,4 +16,17 @@ loadCircleScene(
     float*& color,
     float*& radius);
 
+int
+sceneCircleCount(SceneName sceneName);
+
+bool
+generateCircleRange(
+    SceneName sceneName,
+    int startIndex,
+    int count,
+    float* position,
+    float* color,
+    float* radius,
+    uint64_t seed = DEFAULT_SCENE_SEED);
+
 #endif
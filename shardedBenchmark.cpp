@@ -0,0 +1,359 @@
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+#include <algorithm>
+#include <vector>
+
+#include "circleRenderer.h"
+#include "cycleTimer.h"
+#include "image.h"
+#include "ppm.h"
+#include "tileSequence.h"
+#include "trace.h"
+
+CircleRenderer* createRenderer(const std::string& rendererType);
+
+#define MAX_SHARDS 256
+
+// per frame timings of one worker, in seconds
+struct ShardTiming {
+    double clear;
+    double render;
+    double copy;
+};
+
+// Control block at the start of the shared memory segment.  The
+// coordinator posts frameStart[i] to let worker i render the next
+// frame; each worker posts frameDone once its strip has been copied
+// into the shared framebuffer.
+struct ShardControl {
+    sem_t frameStart[MAX_SHARDS];
+    sem_t frameDone;
+    int workerFailed;
+};
+
+// shardRows --
+//
+// Horizontal strip of image rows [minY, maxY) rendered by a shard.
+static void
+shardRows(int shard, int numShards, int height, int& minY, int& maxY) {
+    minY = static_cast<int>(static_cast<long long>(height) * shard / numShards);
+    maxY = static_cast<int>(static_cast<long long>(height) * (shard + 1) / numShards);
+}
+
+// deadlineAfter --
+//
+// Absolute CLOCK_REALTIME time ms milliseconds from now, for
+// sem_timedwait.
+static struct timespec
+deadlineAfter(long ms) {
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += ms * 1000 * 1000;
+    while (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
+    return deadline;
+}
+
+// runShardWorker --
+//
+// Body of a worker process.  Builds its own renderer and scene (scene
+// generation is deterministic, so every worker sees the same circles),
+// then renders its strip of every frame and copies it into the shared
+// framebuffer.  Exits as soon as the coordinator (parent) dies, so that
+// no orphaned workers are left waiting for frames.  Never returns.
+static void
+runShardWorker(
+    int shard,
+    int numShards,
+    const std::string& rendererType,
+    SceneName sceneName,
+    int width,
+    int height,
+    int totalFrames,
+    pid_t coordinator,
+    ShardControl* control,
+    float* sharedPixels,
+    ShardTiming* timings)
+{
+#if defined(__linux__)
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+    // the coordinator may have died before the signal was asked for
+    if (getppid() != coordinator)
+        _exit(1);
+
+    traceRestartInChild("shard", shard);
+
+    CircleRenderer* renderer = createRenderer(rendererType);
+    if (!renderer->allocOutputImage(width, height)) {
+        fprintf(stderr, "Error: worker %d could not allocate a %dx%d framebuffer\n", shard, width, height);
+        _exit(1);
+    }
+    renderer->loadScene(sceneName);
+    renderer->setup();
+
+    int minY, maxY;
+    shardRows(shard, numShards, height, minY, maxY);
+
+    for (int frame=0; frame<totalFrames; frame++) {
+
+        // the timeout only serves to notice a coordinator that died
+        // where there is no parent death signal
+        for (;;) {
+            struct timespec deadline = deadlineAfter(100);
+            if (sem_timedwait(&control->frameStart[shard], &deadline) == 0)
+                break;
+            if (errno != EINTR && getppid() != coordinator)
+                _exit(1);
+        }
+
+        TRACE_ZONE_ARG("frame", "frame", frame);
+
+        double startClearTime = CycleTimer::currentSeconds();
+        renderer->clearRegion(0, minY, width, maxY);
+        double endClearTime = CycleTimer::currentSeconds();
+
+        renderer->renderRegion(0, minY, width, maxY);
+        double endRenderTime = CycleTimer::currentSeconds();
+
+        const Image* image = renderer->getImage();
+        for (int y=minY; y<maxY; y++) {
+            float* row = &sharedPixels[4 * y * width];
+            const float* src = image->rowPixels(y, 0, width, row);
+            if (src != row)
+                memcpy(row, src, sizeof(float) * 4 * width);
+        }
+        double endCopyTime = CycleTimer::currentSeconds();
+
+        ShardTiming& timing = timings[shard * totalFrames + frame];
+        timing.clear = endClearTime - startClearTime;
+        timing.render = endRenderTime - endClearTime;
+        timing.copy = endCopyTime - endRenderTime;
+
+        sem_post(&control->frameDone);
+    }
+
+    delete renderer;
+    traceWrite();
+    _exit(0);
+}
+
+// waitForShards --
+//
+// Wait until numShards workers have finished the current frame.
+// Returns false if a worker died before finishing.  Only the given
+// worker processes are reaped; a reaped worker's pid is set to -1.
+static bool
+waitForShards(ShardControl* control, int numShards, std::vector<pid_t>& workers) {
+
+    int done = 0;
+    while (done < numShards) {
+
+        struct timespec deadline = deadlineAfter(100);
+        if (sem_timedwait(&control->frameDone, &deadline) == 0) {
+            done++;
+            continue;
+        }
+
+        // no progress for a while, make sure all workers are alive
+        for (size_t i=0; i<workers.size(); i++) {
+            int status;
+            if (workers[i] <= 0 || waitpid(workers[i], &status, WNOHANG) != workers[i])
+                continue;
+            workers[i] = -1;
+            if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+                return false;
+        }
+    }
+    return true;
+}
+
+//This function renders a number of frames with numShards worker processes, each of them
+//rendering one horizontal strip of the image into a shared memory framebuffer. The
+//coordinator (the calling process) waits for all the strips of a frame and saves it.
+//Per-worker timings show how the work scales and how balanced the strips are.
+//It is invoked in benchmark mode with the option -S <number of shards>.
+//
+//Example: ./render -b 3 -S 4 rand100k     renders 3 frames of rand100k with 4 CPU workers
+void
+startShardedBenchmark(
+    const std::string& rendererType,
+    SceneName sceneName,
+    int width,
+    int height,
+    int numShards,
+    int totalFrames,
+    const std::string& frameFilename,
+    ImageFormat format)
+{
+    numShards = std::max(1, std::min(std::min(numShards, height), MAX_SHARDS));
+    totalFrames = std::max(totalFrames, 0);
+
+    // shared segment: control block, framebuffer, timings
+    size_t controlBytes = (sizeof(ShardControl) + FRAMEBUFFER_ALIGNMENT - 1) / FRAMEBUFFER_ALIGNMENT * FRAMEBUFFER_ALIGNMENT;
+    size_t pixelBytes = sizeof(float) * 4 * width * height;
+    size_t timingBytes = sizeof(ShardTiming) * numShards * std::max(totalFrames, 1);
+    size_t sharedBytes = controlBytes + pixelBytes + timingBytes;
+
+    char* shared = static_cast<char*>(mmap(NULL, sharedBytes, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Error: could not map %zu bytes of shared memory\n", sharedBytes);
+        exit(1);
+    }
+
+    ShardControl* control = reinterpret_cast<ShardControl*>(shared);
+    float* sharedPixels = reinterpret_cast<float*>(shared + controlBytes);
+    ShardTiming* timings = reinterpret_cast<ShardTiming*>(shared + controlBytes + pixelBytes);
+
+    for (int i=0; i<numShards; i++)
+        sem_init(&control->frameStart[i], 1, 0);
+    sem_init(&control->frameDone, 1, 0);
+
+    Image image(width, height, sharedPixels);
+    const char* extension = imageFormatExtension(format);
+
+    printf("\nRunning sharded benchmark, %d frames, %d %s workers...\n", totalFrames, numShards, rendererType.c_str());
+    TileSequenceWriter sequence;
+    if (format == IMAGE_FORMAT_TILE_SEQUENCE) {
+        char filename[1024];
+        sprintf(filename, "%s_%s.%s", frameFilename.c_str(), rendererType.c_str(), extension);
+        if (!sequence.open(filename, width, height, TILE_SEQUENCE_TILE_SIZE))
+            exit(1);
+        printf("Writing frames to the tile sequence %s\n", filename);
+    } else {
+        printf("Dumping frames to %s_frameXXX_%s.%s\n", frameFilename.c_str(), rendererType.c_str(), extension);
+    }
+
+    // flush before forking, or the children inherit buffered output
+    fflush(stdout);
+
+    pid_t coordinator = getpid();
+    std::vector<pid_t> workers;
+    for (int shard=0; shard<numShards; shard++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Error: could not fork worker %d\n", shard);
+            exit(1);
+        }
+        if (pid == 0)
+            runShardWorker(shard, numShards, rendererType, sceneName, width, height,
+                           totalFrames, coordinator, control, sharedPixels, timings);
+        workers.push_back(pid);
+    }
+
+    double startTime = CycleTimer::currentSeconds();
+    double totalFrameTime = 0.f;
+    bool failed = false;
+
+    for (int frame=0; frame<totalFrames && !failed; frame++) {
+
+        double startFrameTime = CycleTimer::currentSeconds();
+
+        for (int shard=0; shard<numShards; shard++)
+            sem_post(&control->frameStart[shard]);
+
+        if (!waitForShards(control, numShards, workers)) {
+            fprintf(stderr, "Error: a worker process failed\n");
+            failed = true;
+            break;
+        }
+
+        double endFrameTime = CycleTimer::currentSeconds();
+
+        if (format == IMAGE_FORMAT_TILE_SEQUENCE) {
+            sequence.writeFrame(&image, NULL);
+        } else {
+            char filename[1024];
+            sprintf(filename, "%s_frame%d_%s.%s", frameFilename.c_str(), frame, rendererType.c_str(), extension);
+            writeImage(&image, filename, format);
+        }
+
+        double endFileSaveTime = CycleTimer::currentSeconds();
+
+        double frameTime = endFrameTime - startFrameTime;
+        totalFrameTime += frameTime;
+
+        printf("Frame:    %.4f ms\n", 1000.f * frameTime);
+        printf("File IO:  %.4f ms\n", 1000.f * (endFileSaveTime - endFrameTime));
+        printf("\n");
+    }
+
+    if (failed) {
+        for (size_t i=0; i<workers.size(); i++)
+            if (workers[i] > 0)
+                kill(workers[i], SIGKILL);
+    }
+    for (size_t i=0; i<workers.size(); i++)
+        if (workers[i] > 0)
+            waitpid(workers[i], NULL, 0);
+
+    double totalTime = CycleTimer::currentSeconds() - startTime;
+
+    if (!failed && totalFrames > 0) {
+
+        // per worker averages over all frames.  Busy time is what the
+        // worker spent on the frame; the frame can only complete once
+        // the busiest worker is done, so max/mean busy time is the
+        // load imbalance of the strip decomposition
+        printf("Shard  Rows          Clear(ms)   Render(ms)  Copy(ms)    Busy(ms)\n");
+
+        double maxBusy = 0.f;
+        double sumBusy = 0.f;
+
+        for (int shard=0; shard<numShards; shard++) {
+            double clear = 0.f, render = 0.f, copy = 0.f;
+            for (int frame=0; frame<totalFrames; frame++) {
+                const ShardTiming& timing = timings[shard * totalFrames + frame];
+                clear += timing.clear;
+                render += timing.render;
+                copy += timing.copy;
+            }
+            clear /= totalFrames;
+            render /= totalFrames;
+            copy /= totalFrames;
+            double busy = clear + render + copy;
+            maxBusy = std::max(maxBusy, busy);
+            sumBusy += busy;
+
+            int minY, maxY;
+            shardRows(shard, numShards, height, minY, maxY);
+            printf("%-6d [%4d,%4d)   %-11.4f %-11.4f %-11.4f %-11.4f\n", shard, minY, maxY,
+                   1000.f * clear, 1000.f * render, 1000.f * copy, 1000.f * busy);
+        }
+
+        double meanBusy = sumBusy / numShards;
+        printf("\n");
+        printf("Frame:    %.4f ms (average)\n", 1000.f * totalFrameTime / totalFrames);
+        printf("Work:     %.4f ms (sum of worker busy time per frame)\n", 1000.f * sumBusy);
+        printf("Imbalance: %.2fx (max / mean worker busy time)\n", meanBusy > 0.f ? maxBusy / meanBusy : 1.f);
+    }
+
+    printf("\n");
+    printf("Overall:  %.4f sec (note units are seconds)\n", totalTime);
+
+    sequence.close();
+
+    for (int i=0; i<numShards; i++)
+        sem_destroy(&control->frameStart[i]);
+    sem_destroy(&control->frameDone);
+    munmap(shared, sharedBytes);
+
+    if (failed)
+        exit(1);
+}
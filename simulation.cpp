@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <string.h>
+
+#include "simulation.h"
+#include "counterRng.h"
+#include "cycleTimer.h"
+#include "sceneLoader.h"
+#include "trace.h"
+#include "workerPool.h"
+
+// random streams of the initial velocities, past those the scene
+// generators draw the circles from, so that speed does not follow depth
+// or radius
+enum {
+    STREAM_VELOCITY_X = 16,
+    STREAM_VELOCITY_Y
+};
+
+
+SimulationPipeline::SimulationPipeline(SceneName sceneName, int numThreads) {
+
+    float* position;
+    loadCircleScene(sceneName, circles, position, circleColor, circleRadius);
+
+    // depths never change, both buffers start as the loaded scene
+    positionBuffers[0] = position;
+    positionBuffers[1] = new float[3 * circles];
+    memcpy(positionBuffers[1], position, sizeof(float) * 3 * circles);
+    front = 0;
+
+    x.resize(circles);
+    y.resize(circles);
+    vx.resize(circles);
+    vy.resize(circles);
+    for (int i=0; i<circles; i++) {
+        x[i] = position[3 * i];
+        y[i] = position[3 * i + 1];
+        vx[i] = SIMULATION_MAX_SPEED * (2.f * counterRandomFloat(DEFAULT_SCENE_SEED, i, STREAM_VELOCITY_X) - 1.f);
+        vy[i] = SIMULATION_MAX_SPEED * (2.f * counterRandomFloat(DEFAULT_SCENE_SEED, i, STREAM_VELOCITY_Y) - 1.f);
+    }
+
+    pool = new WorkerPool(numThreads);
+    stepRequested = true;
+    stepDone = false;
+    stopping = false;
+    stepTime = 0.0;
+    waitTime = 0.0;
+
+    driver = std::thread(&SimulationPipeline::simulationLoop, this);
+}
+
+SimulationPipeline::~SimulationPipeline() {
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    stepChanged.notify_all();
+    driver.join();
+
+    delete pool;
+    delete [] positionBuffers[0];
+    delete [] positionBuffers[1];
+    delete [] circleColor;
+    delete [] circleRadius;
+}
+
+int
+SimulationPipeline::numThreads() const {
+    return pool->size();
+}
+
+void
+SimulationPipeline::swap() {
+
+    double startTime = CycleTimer::currentSeconds();
+    {
+        TRACE_ZONE("simulation wait");
+        std::unique_lock<std::mutex> guard(lock);
+        stepChanged.wait(guard, [this]() { return stepDone; });
+        waitTime = CycleTimer::currentSeconds() - startTime;
+        stepDone = false;
+        front = 1 - front;
+        stepRequested = true;
+    }
+    stepChanged.notify_all();
+}
+
+// simulationLoop --
+//
+// Body of the driver thread: runs every requested step on the pool,
+// writing the back buffer, and reports it done.
+void
+SimulationPipeline::simulationLoop() {
+
+    traceSetThreadName("simulation", 0);
+
+    while (true) {
+
+        float* target;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            stepChanged.wait(guard, [this]() { return stopping || stepRequested; });
+            if (stopping)
+                return;
+            stepRequested = false;
+            target = positionBuffers[1 - front];
+        }
+
+        TRACE_ZONE("simulate");
+        double startTime = CycleTimer::currentSeconds();
+
+        int chunkSize = (circles + pool->size() - 1) / pool->size();
+        pool->run([&](int thread) {
+            int begin = std::min(circles, thread * chunkSize);
+            step(begin, std::min(circles, begin + chunkSize), target);
+        });
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stepTime = CycleTimer::currentSeconds() - startTime;
+            stepDone = true;
+        }
+        stepChanged.notify_all();
+    }
+}
+
+// step --
+//
+// Advances circles [begin, end) by one time step and writes their
+// positions into target.  The loop has no branches (the compiler turns
+// the selects into vector blends): a circle that crossed a border is
+// mirrored back inside, and its velocity across that border reversed
+// and damped.
+void
+SimulationPipeline::step(int begin, int end, float* target) {
+
+    const float dt = SIMULATION_TIME_STEP;
+    float* px = &x[0];
+    float* py = &y[0];
+    float* pvx = &vx[0];
+    float* pvy = &vy[0];
+    const float* rad = circleRadius;
+
+    for (int i=begin; i<end; i++) {
+
+        // circles larger than the image stay centered
+        float low = std::min(rad[i], 0.5f);
+        float high = 1.f - low;
+
+        float velX = pvx[i];
+        float velY = pvy[i] - SIMULATION_GRAVITY * dt;
+        float newX = px[i] + velX * dt;
+        float newY = py[i] + velY * dt;
+
+        bool outX = (newX < low) | (newX > high);
+        bool outY = (newY < low) | (newY > high);
+        float wallX = newX < low ? low : high;
+        float wallY = newY < low ? low : high;
+
+        px[i] = std::min(std::max(outX ? 2.f * wallX - newX : newX, low), high);
+        py[i] = std::min(std::max(outY ? 2.f * wallY - newY : newY, low), high);
+        pvx[i] = outX ? -SIMULATION_RESTITUTION * velX : velX;
+        pvy[i] = outY ? -SIMULATION_RESTITUTION * velY : velY;
+    }
+
+    for (int i=begin; i<end; i++) {
+        target[3 * i] = px[i];
+        target[3 * i + 1] = py[i];
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "circleRenderer.h"
+
+class WorkerPool;
+
+// fixed time step of one frame, in seconds
+#define SIMULATION_TIME_STEP (1.f / 60.f)
+// downwards acceleration, in image heights per second squared
+#define SIMULATION_GRAVITY 0.5f
+// fraction of the speed kept when bouncing off a wall
+#define SIMULATION_RESTITUTION 0.9f
+// largest initial speed along each axis, in images per second
+#define SIMULATION_MAX_SPEED 0.2f
+
+
+// SimulationPipeline --
+//
+// The "update position" stage of every frame (--simulate): circles
+// move with their own velocity, fall with gravity and bounce off the
+// image borders.  The state is kept in SoA columns (x, y, vx, vy) that
+// every simulation thread sweeps over its own contiguous range.
+//
+// The scene positions are double buffered.  The renderer draws frame N
+// from the front buffer while the simulation threads write step N+1
+// into the back buffer; swap() at the frame boundary waits for that
+// step, exchanges the buffers and starts the next step right away, so
+// a frame costs about max(simulation, rendering) instead of their sum
+// (as long as the two do not compete for the same cores).  Colors,
+// radii and depths do not change and are shared by both buffers.
+class SimulationPipeline {
+
+public:
+
+    // loads the scene, and starts computing the first step
+    SimulationPipeline(SceneName sceneName, int numThreads);
+    ~SimulationPipeline();
+
+    int numCircles() const { return circles; }
+
+    // scene of the current frame, in the layout of loadCircleScene.
+    // Valid until the next swap()
+    const float* position() const { return positionBuffers[front]; }
+    const float* color() const { return circleColor; }
+    const float* radius() const { return circleRadius; }
+
+    int numThreads() const;
+
+    // swap --
+    //
+    // Waits for the step in flight, makes it the current frame and
+    // starts the next one.  The previous front buffer must not be read
+    // anymore.
+    void swap();
+
+    // duration of the last completed step, and the time the last
+    // swap() spent waiting for it, in seconds
+    double lastStepTime() const { return stepTime; }
+    double lastWaitTime() const { return waitTime; }
+
+private:
+
+    SimulationPipeline(const SimulationPipeline&);
+    SimulationPipeline& operator=(const SimulationPipeline&);
+
+    void simulationLoop();
+    void step(int begin, int end, float* target);
+
+    int circles;
+    float* positionBuffers[2];
+    int front;
+    float* circleColor;
+    float* circleRadius;
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+
+    WorkerPool* pool;
+    std::thread driver;
+    std::mutex lock;
+    std::condition_variable stepChanged;
+    bool stepRequested;
+    bool stepDone;
+    bool stopping;
+
+    double stepTime;
+    double waitTime;
+};
+
+
+#endif
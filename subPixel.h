@@ -0,0 +1,32 @@
+#ifndef __SUB_PIXEL_H__
+#define __SUB_PIXEL_H__
+
+#include <algorithm>
+#include <math.h>
+
+// Circles with a radius below this many pixels can only contain the
+// 2x2 pixel centers around their own center: the next row or column of
+// centers is at least one pixel away.  The margin below one pixel keeps
+// the classification safe from float rounding.
+#define SUBPIXEL_MAX_RADIUS 0.9375f
+
+// isSubPixelCircle --
+//
+// True if the circle (radius in normalized coordinates) can cover at
+// most the 2x2 pixel centers returned by subPixelCandidates.
+static inline bool
+isSubPixelCircle(float rad, int width, int height) {
+    return rad * std::max(width, height) < SUBPIXEL_MAX_RADIUS;
+}
+
+// subPixelCandidates --
+//
+// Top left pixel of the 2x2 block of pixels whose centers are closest
+// to the circle center.
+static inline void
+subPixelCandidates(float px, float py, int width, int height, int& pixelX, int& pixelY) {
+    pixelX = static_cast<int>(floorf(px * width - 0.5f));
+    pixelY = static_cast<int>(floorf(py * height - 0.5f));
+}
+
+#endif
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "tileSequence.h"
+#include "image.h"
+#include "trace.h"
+#include "util.h"
+
+uint64_t
+hashPixelRect(const Image* image, int minX, int minY, int maxX, int maxY) {
+
+    // scratch for rows that cross the tiles of a tiled framebuffer
+    std::vector<float> scratch(image->tileSize ? 4 * (maxX - minX) : 0);
+
+    uint64_t hash = 0;
+    for (int y=minY; y<maxY; y++) {
+        const float* ptr = image->rowPixels(y, minX, maxX, scratch.data());
+        for (int x=minX; x<maxX; x++) {
+            hash += hashPixel(ptr, static_cast<uint32_t>(y * image->width + x));
+            ptr += 4;
+        }
+    }
+    return hash;
+}
+
+static void
+putU32(unsigned char* out, uint32_t value) {
+    out[0] = static_cast<unsigned char>(value);
+    out[1] = static_cast<unsigned char>(value >> 8);
+    out[2] = static_cast<unsigned char>(value >> 16);
+    out[3] = static_cast<unsigned char>(value >> 24);
+}
+
+static uint32_t
+getU32(const unsigned char* in) {
+    return static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8 |
+           static_cast<uint32_t>(in[2]) << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+
+// tileRect --
+//
+// Pixels [minX, maxX) x [minY, maxY) of a tile, clipped to the image.
+static void
+tileRect(int tile, int tilesX, int tileSize, int width, int height,
+         int& minX, int& minY, int& maxX, int& maxY) {
+    minX = (tile % tilesX) * tileSize;
+    minY = (tile / tilesX) * tileSize;
+    maxX = std::min(minX + tileSize, width);
+    maxY = std::min(minY + tileSize, height);
+}
+
+
+TileSequenceWriter::TileSequenceWriter() {
+    fp = NULL;
+    width = height = 0;
+    tileSize = 0;
+    tilesX = tilesY = 0;
+    frameCount = 0;
+    changedTiles = 0;
+}
+
+TileSequenceWriter::~TileSequenceWriter() {
+    close();
+}
+
+bool
+TileSequenceWriter::open(const char* filename, int imageWidth, int imageHeight, int size) {
+
+    close();
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s for write\n", filename);
+        return false;
+    }
+
+    width = imageWidth;
+    height = imageHeight;
+    tileSize = size;
+    tilesX = tileGridSize(width, tileSize);
+    tilesY = tileGridSize(height, tileSize);
+    frameCount = 0;
+    previousHashes.clear();
+
+    // the frame count is filled in by close()
+    unsigned char header[TILE_SEQUENCE_HEADER_BYTES];
+    memcpy(header, "TSEQ", 4);
+    putU32(header + 4, TILE_SEQUENCE_VERSION);
+    putU32(header + 8, width);
+    putU32(header + 12, height);
+    putU32(header + 16, tileSize);
+    putU32(header + 20, 0);
+
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+}
+
+size_t
+TileSequenceWriter::writeFrame(const Image* image, const uint64_t* tileHashes) {
+
+    if (!fp || image->width != width || image->height != height)
+        return 0;
+
+    TRACE_ZONE("encode");
+
+    int numTiles = tilesX * tilesY;
+
+    if (!tileHashes) {
+        hashes.resize(numTiles);
+        for (int tile=0; tile<numTiles; tile++) {
+            int minX, minY, maxX, maxY;
+            tileRect(tile, tilesX, tileSize, width, height, minX, minY, maxX, maxY);
+            hashes[tile] = hashPixelRect(image, minX, minY, maxX, maxY);
+        }
+        tileHashes = &hashes[0];
+    }
+
+    // keyframe: every tile
+    changed.clear();
+    bool keyframe = previousHashes.empty();
+    for (int tile=0; tile<numTiles; tile++)
+        if (keyframe || tileHashes[tile] != previousHashes[tile])
+            changed.push_back(tile);
+    previousHashes.assign(tileHashes, tileHashes + numTiles);
+    changedTiles = static_cast<int>(changed.size());
+
+    // record: tag, tile count, tile indexes, pixels
+    size_t pixelBytes = 0;
+    for (size_t i=0; i<changed.size(); i++) {
+        int minX, minY, maxX, maxY;
+        tileRect(changed[i], tilesX, tileSize, width, height, minX, minY, maxX, maxY);
+        pixelBytes += 3 * (maxX - minX) * (maxY - minY);
+    }
+
+    size_t recordBytes = 8 + 4 * changed.size() + pixelBytes;
+    pixels.resize(recordBytes);
+    unsigned char* out = &pixels[0];
+
+    memcpy(out, "FRAM", 4);
+    putU32(out + 4, static_cast<uint32_t>(changed.size()));
+    out += 8;
+    for (size_t i=0; i<changed.size(); i++) {
+        putU32(out, changed[i]);
+        out += 4;
+    }
+
+    // same conversion as writePPMImage, top row of the tile first
+    std::vector<float> scratch(4 * std::min(tileSize, width));
+    for (size_t i=0; i<changed.size(); i++) {
+        int minX, minY, maxX, maxY;
+        tileRect(changed[i], tilesX, tileSize, width, height, minX, minY, maxX, maxY);
+        for (int y=maxY-1; y>=minY; y--) {
+            const float* ptr = image->rowPixels(y, minX, maxX, &scratch[0]);
+            for (int x=minX; x<maxX; x++) {
+                out[0] = static_cast<unsigned char>(255.f * CLAMP(ptr[0], 0.f, 1.f));
+                out[1] = static_cast<unsigned char>(255.f * CLAMP(ptr[1], 0.f, 1.f));
+                out[2] = static_cast<unsigned char>(255.f * CLAMP(ptr[2], 0.f, 1.f));
+                out += 3;
+                ptr += 4;
+            }
+        }
+    }
+
+    if (fwrite(&pixels[0], 1, recordBytes, fp) != recordBytes) {
+        fprintf(stderr, "Error: could not write tile sequence frame\n");
+        return 0;
+    }
+
+    frameCount++;
+    return recordBytes;
+}
+
+void
+TileSequenceWriter::close() {
+
+    if (!fp)
+        return;
+
+    unsigned char count[4];
+    putU32(count, frameCount);
+    fseek(fp, 20, SEEK_SET);
+    fwrite(count, 1, sizeof(count), fp);
+    fclose(fp);
+    fp = NULL;
+}
+
+
+TileSequenceReader::TileSequenceReader() {
+    fp = NULL;
+    width = height = 0;
+    tileSize = 0;
+    frameCount = 0;
+    framesRead = 0;
+}
+
+TileSequenceReader::~TileSequenceReader() {
+    close();
+}
+
+bool
+TileSequenceReader::open(const char* filename) {
+
+    close();
+
+    fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s\n", filename);
+        return false;
+    }
+
+    unsigned char header[TILE_SEQUENCE_HEADER_BYTES];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, "TSEQ", 4) != 0 || getU32(header + 4) != TILE_SEQUENCE_VERSION) {
+        fprintf(stderr, "Error: %s is not a tile sequence file\n", filename);
+        close();
+        return false;
+    }
+
+    width = getU32(header + 8);
+    height = getU32(header + 12);
+    tileSize = getU32(header + 16);
+    frameCount = getU32(header + 20);
+    framesRead = 0;
+
+    if (width <= 0 || height <= 0 || tileSize <= 0) {
+        fprintf(stderr, "Error: %s has an invalid header\n", filename);
+        close();
+        return false;
+    }
+
+    frame.assign(3 * static_cast<size_t>(width) * height, 0);
+    return true;
+}
+
+bool
+TileSequenceReader::readFrame() {
+
+    if (!fp || framesRead >= frameCount)
+        return false;
+
+    unsigned char record[8];
+    if (fread(record, 1, sizeof(record), fp) != sizeof(record) || memcmp(record, "FRAM", 4) != 0) {
+        fprintf(stderr, "Error: corrupt tile sequence frame %d\n", framesRead);
+        return false;
+    }
+
+    int tilesX = tileGridSize(width, tileSize);
+    int tilesY = tileGridSize(height, tileSize);
+    uint32_t numTiles = getU32(record + 4);
+    if (numTiles > static_cast<uint32_t>(tilesX * tilesY))
+        return false;
+
+    std::vector<unsigned char> indexes(4 * numTiles);
+    if (numTiles > 0 && fread(&indexes[0], 1, indexes.size(), fp) != indexes.size())
+        return false;
+
+    tiles.resize(numTiles);
+    for (uint32_t i=0; i<numTiles; i++) {
+        tiles[i] = getU32(&indexes[4 * i]);
+        if (tiles[i] >= static_cast<uint32_t>(tilesX * tilesY))
+            return false;
+    }
+
+    for (uint32_t i=0; i<numTiles; i++) {
+
+        uint32_t tile = tiles[i];
+
+        int minX, minY, maxX, maxY;
+        tileRect(tile, tilesX, tileSize, width, height, minX, minY, maxX, maxY);
+
+        size_t rowBytes = 3 * (maxX - minX);
+        tilePixels.resize(rowBytes * (maxY - minY));
+        if (fread(&tilePixels[0], 1, tilePixels.size(), fp) != tilePixels.size())
+            return false;
+
+        // tile rows are stored top first; frame rows too
+        for (int y=maxY-1; y>=minY; y--) {
+            const unsigned char* src = &tilePixels[rowBytes * (maxY - 1 - y)];
+            size_t frameRow = height - 1 - y;
+            memcpy(&frame[3 * (frameRow * width + minX)], src, rowBytes);
+        }
+    }
+
+    framesRead++;
+    return true;
+}
+
+void
+TileSequenceReader::close() {
+
+    if (fp)
+        fclose(fp);
+    fp = NULL;
+}
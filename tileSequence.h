@@ -0,0 +1,147 @@
+#ifndef __TILE_SEQUENCE_H__
+#define __TILE_SEQUENCE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "counterRng.h"
+
+struct Image;
+
+// Tile-delta sequence container (.tseq), all integers little endian:
+//
+//   header:  "TSEQ", version, width, height, tileSize, frameCount   (u32 each)
+//   frame:   "FRAM", numTiles (u32), numTiles tile indexes (u32),
+//            then the RGB24 pixels of those tiles, in the same order
+//
+// The first frame is a keyframe and stores every tile; the following
+// frames store only the tiles whose hash changed since the previous
+// frame.  Tiles are numbered row by row from the bottom left corner of
+// the image (like the renderers' tiles), and the pixels of a tile are
+// stored row by row from its top row, so that a decoded frame is
+// written to PPM as is.
+#define TILE_SEQUENCE_VERSION 1
+#define TILE_SEQUENCE_HEADER_BYTES 24
+
+// tile size of the sequences written by the benchmark, the tiled
+// renderer's default so that it can provide the tile hashes
+#define TILE_SEQUENCE_TILE_SIZE 32
+
+// hashPixel --
+//
+// Hash of one pixel of a tile hash.  A tile hash is the sum of the
+// hashes of its pixels, so it does not depend on the order (or on the
+// threads) in which the parts of a tile are hashed.
+static inline uint64_t
+hashPixel(const float* rgba, uint32_t pixelIndex) {
+
+    uint32_t bits[4];
+    memcpy(bits, rgba, sizeof(bits));
+
+    uint64_t h = splitMix64(static_cast<uint64_t>(bits[0]) << 32 | (bits[1] ^ pixelIndex));
+    return splitMix64(h ^ (static_cast<uint64_t>(bits[2]) << 32 | bits[3]));
+}
+
+// hashPixelRect --
+//
+// Sum of the pixel hashes of [minX, maxX) x [minY, maxY).
+uint64_t hashPixelRect(const Image* image, int minX, int minY, int maxX, int maxY);
+
+// tileGridSize --
+//
+// Number of tiles of the given size covering one image dimension.
+static inline int
+tileGridSize(int pixels, int tileSize) {
+    return (pixels + tileSize - 1) / tileSize;
+}
+
+
+// TileSequenceWriter --
+//
+// Writes frames to a .tseq file.  Frames are compared with the previous
+// one through per tile hashes, either the ones given by the renderer
+// (computed while rendering) or computed here.
+class TileSequenceWriter {
+
+public:
+
+    TileSequenceWriter();
+    ~TileSequenceWriter();
+
+    bool open(const char* filename, int width, int height, int tileSize);
+
+    // Appends a frame.  tileHashes (tiles numbered as in the
+    // container) may be NULL.  Returns the number of bytes written, 0 on
+    // error.
+    size_t writeFrame(const Image* image, const uint64_t* tileHashes);
+
+    // writes the final frame count and closes the file
+    void close();
+
+    int lastChangedTiles() const { return changedTiles; }
+    int tileCount() const { return tilesX * tilesY; }
+
+private:
+
+    TileSequenceWriter(const TileSequenceWriter&);
+    TileSequenceWriter& operator=(const TileSequenceWriter&);
+
+    FILE* fp;
+    int width;
+    int height;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+    int frameCount;
+    int changedTiles;
+
+    std::vector<uint64_t> previousHashes;
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> changed;
+    std::vector<unsigned char> pixels;
+};
+
+
+// TileSequenceReader --
+//
+// Reads a .tseq file frame by frame into an RGB24 frame (top row
+// first).
+class TileSequenceReader {
+
+public:
+
+    TileSequenceReader();
+    ~TileSequenceReader();
+
+    bool open(const char* filename);
+
+    // decodes the next frame on top of the current one
+    bool readFrame();
+
+    void close();
+
+    // number of tiles stored for the last frame read
+    int lastTileCount() const { return static_cast<int>(tiles.size()); }
+
+    int width;
+    int height;
+    int tileSize;
+    int frameCount;
+    int framesRead;
+
+    // the current frame, 3 * width * height bytes
+    std::vector<unsigned char> frame;
+
+private:
+
+    TileSequenceReader(const TileSequenceReader&);
+    TileSequenceReader& operator=(const TileSequenceReader&);
+
+    FILE* fp;
+    std::vector<uint32_t> tiles;
+    std::vector<unsigned char> tilePixels;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "tileSequence.h"
+
+
+// Decoder for the tile-delta sequences written with -F tseq.  Rebuilds
+// one frame (or all of them) and saves it as PPM.
+//
+// Example: ./tseqdecode image_tiled.tseq 7 frame7.ppm
+//          ./tseqdecode image_tiled.tseq all frame        (frame_0000.ppm, frame_0001.ppm, ...)
+
+
+static void
+usage(const char* progname) {
+    printf("Usage: %s FILE.tseq <FRAME|all|info> [OUTPUT]\n", progname);
+    printf("  FRAME   Decode frame number FRAME into OUTPUT (a PPM file)\n");
+    printf("  all     Decode every frame into OUTPUT_xxxx.ppm\n");
+    printf("  info    Print the sequence header and the changed tiles of every frame\n");
+}
+
+static bool
+writeFrame(const TileSequenceReader& reader, const char* filename) {
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open %s for write\n", filename);
+        return false;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", reader.width, reader.height);
+    bool ok = fwrite(&reader.frame[0], 1, reader.frame.size(), fp) == reader.frame.size();
+    fclose(fp);
+    printf("Wrote image file %s\n", filename);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string mode = argv[2];
+    bool info = mode == "info";
+    bool all = mode == "all";
+    int target = -1;
+
+    if (!info && !all && sscanf(argv[2], "%d", &target) != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!info && argc < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TileSequenceReader reader;
+    if (!reader.open(argv[1]))
+        return 1;
+
+    if (info)
+        printf("%dx%d, %dx%d tiles, %d frames\n", reader.width, reader.height,
+               reader.tileSize, reader.tileSize, reader.frameCount);
+
+    if (target >= reader.frameCount) {
+        fprintf(stderr, "Error: frame %d out of range (%d frames)\n", target, reader.frameCount);
+        return 1;
+    }
+
+    // every frame is the previous one plus its changed tiles, so frames
+    // are decoded in order up to the one requested
+    while (reader.framesRead < reader.frameCount) {
+
+        int frame = reader.framesRead;
+        if (!reader.readFrame()) {
+            fprintf(stderr, "Error: could not decode frame %d\n", frame);
+            return 1;
+        }
+
+        if (info) {
+            printf("Frame %d: %d tiles\n", frame, reader.lastTileCount());
+        } else if (all) {
+            char filename[1024];
+            sprintf(filename, "%s_%04d.ppm", argv[3], frame);
+            if (!writeFrame(reader, filename))
+                return 1;
+        } else if (frame == target) {
+            return writeFrame(reader, argv[3]) ? 0 : 1;
+        }
+    }
+
+    return 0;
+}
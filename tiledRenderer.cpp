@@ -0,0 +1,1672 @@
+#include <algorithm>
+#include <deque>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "tiledRenderer.h"
+#include "autotune.h"
+#include "compactScene.h"
+#include "coverage.h"
+#include "cycleTimer.h"
+#include "image.h"
+#include "numaTopology.h"
+#include "sceneLoader.h"
+#include "subPixel.h"
+#include "tileSequence.h"
+#include "trace.h"
+#include "util.h"
+#include "workerPool.h"
+
+// Fixed cost of processing one circle in a tile (setting up the bounding
+// box loop), expressed in pixel tests
+#define CIRCLE_SETUP_COST 16.f
+
+// Tiles are split into sub-tiles while their estimated cost exceeds this
+// fraction of the average work per thread, and they are larger than
+// MIN_SUBTILE_SIZE pixels
+#define SPLIT_COST_FRACTION 0.25f
+#define MIN_SUBTILE_SIZE 8
+
+// Estimated cost of a sub-pixel circle (at most 4 pixel tests, no
+// bounding box loop), and the tile list flag that marks it
+#define SUBPIXEL_CIRCLE_COST 4.f
+#define SUBPIXEL_CIRCLE_FLAG 0x80000000u
+
+// CircleFootprint flags
+#define FOOTPRINT_CULLED   0x1
+#define FOOTPRINT_SUBPIXEL 0x2
+
+
+// WorkDeque --
+//
+// Work items of one thread.  The owner takes items from the front
+// (most expensive first), idle threads steal from the back.
+struct WorkDeque {
+    std::mutex lock;
+    std::deque<int> items;
+
+    bool popFront(int& item) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (items.empty())
+            return false;
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool stealBack(int& item) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (items.empty())
+            return false;
+        item = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+// circleScreenBox --
+//
+// Screen bounding box of a circle, computed exactly as in
+// RefRenderer::render, clamped to the region.  Returns false if the box
+// is empty.
+static inline bool
+circleScreenBox(
+    float px, float py, float rad,
+    int width, int height,
+    int regionMinX, int regionMinY, int regionMaxX, int regionMaxY,
+    int& screenMinX, int& screenMinY, int& screenMaxX, int& screenMaxY)
+{
+    float minX = px - rad;
+    float maxX = px + rad;
+    float minY = py - rad;
+    float maxY = py + rad;
+
+    screenMinX = CLAMP(static_cast<int>(minX * width), regionMinX, regionMaxX);
+    screenMaxX = CLAMP(static_cast<int>(maxX * width)+1, regionMinX, regionMaxX);
+    screenMinY = CLAMP(static_cast<int>(minY * height), regionMinY, regionMaxY);
+    screenMaxY = CLAMP(static_cast<int>(maxY * height)+1, regionMinY, regionMaxY);
+
+    return screenMinX < screenMaxX && screenMinY < screenMaxY;
+}
+
+// circleGeometry --
+//
+// Position and radius of a circle, decoded from the compact scene if
+// there is one.
+static inline void
+circleGeometry(const TiledRenderer::SceneColumns& scene, int circleIndex, float& px, float& py, float& rad) {
+
+    if (scene.compact) {
+        scene.compact->decodeGeometry(circleIndex, px, py, rad);
+    } else {
+        px = scene.position[3*circleIndex];
+        py = scene.position[3*circleIndex+1];
+        rad = scene.radius[circleIndex];
+    }
+}
+
+// circleFootprint --
+//
+// Screen box and binning flags of a circle, as binCircles computes them.
+static inline TiledRenderer::CircleFootprint
+circleFootprint(const TiledRenderer::SceneColumns& scene, int circleIndex, bool antialias,
+                int width, int height, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    float px, py, rad;
+    circleGeometry(scene, circleIndex, px, py, rad);
+    float reach = antialias ? rad + coverageReach(width) : rad;
+
+    TiledRenderer::CircleFootprint footprint;
+    if (rad <= 0.f ||
+        !circleScreenBox(px, py, reach, width, height, regionMinX, regionMinY, regionMaxX, regionMaxY,
+                         footprint.minX, footprint.minY, footprint.maxX, footprint.maxY)) {
+        footprint.minX = footprint.minY = footprint.maxX = footprint.maxY = 0;
+        footprint.flags = FOOTPRINT_CULLED;
+    } else {
+        footprint.flags = !antialias && isSubPixelCircle(rad, width, height) ? FOOTPRINT_SUBPIXEL : 0;
+    }
+    return footprint;
+}
+
+// sameTiles --
+//
+// Whether two footprints put the circle in the same tile lists, with the
+// same entry.
+static inline bool
+sameTiles(const TiledRenderer::CircleFootprint& a, const TiledRenderer::CircleFootprint& b, int tileSize) {
+
+    if (a.flags != b.flags)
+        return false;
+    if (a.flags & FOOTPRINT_CULLED)
+        return true;
+    return a.minX / tileSize == b.minX / tileSize && (a.maxX - 1) / tileSize == (b.maxX - 1) / tileSize &&
+           a.minY / tileSize == b.minY / tileSize && (a.maxY - 1) / tileSize == (b.maxY - 1) / tileSize;
+}
+
+// addFootprintCost --
+//
+// Adds sign times the cost estimate binCircles charges for the circle to
+// the tiles it covers.
+static inline void
+addFootprintCost(const TiledRenderer::CircleFootprint& footprint, int tileSize, int tilesX, float sign, float* costs) {
+
+    if (footprint.flags & FOOTPRINT_CULLED)
+        return;
+    for (int tileY=footprint.minY/tileSize; tileY<=(footprint.maxY-1)/tileSize; tileY++) {
+        int spanY = std::min(footprint.maxY, (tileY+1) * tileSize) - std::max(footprint.minY, tileY * tileSize);
+        for (int tileX=footprint.minX/tileSize; tileX<=(footprint.maxX-1)/tileSize; tileX++) {
+            int spanX = std::min(footprint.maxX, (tileX+1) * tileSize) - std::max(footprint.minX, tileX * tileSize);
+            float cost = (footprint.flags & FOOTPRINT_SUBPIXEL) ? SUBPIXEL_CIRCLE_COST
+                                                                : CIRCLE_SETUP_COST + static_cast<float>(spanX * spanY);
+            costs[tileY * tilesX + tileX] += sign * cost;
+        }
+    }
+}
+
+static inline void
+circleColor(const TiledRenderer::SceneColumns& scene, int circleIndex, float& r, float& g, float& b) {
+
+    if (scene.compact) {
+        scene.compact->decodeColor(circleIndex, r, g, b);
+    } else {
+        r = scene.color[3*circleIndex];
+        g = scene.color[3*circleIndex+1];
+        b = scene.color[3*circleIndex+2];
+    }
+}
+
+TiledRenderer::TiledRenderer() {
+    image = NULL;
+
+    numCircles = 0;
+    position = NULL;
+    color = NULL;
+    radius = NULL;
+    ownsScene = false;
+
+    tileSize = DEFAULT_TILE_SIZE;
+    tiledLayout = false;
+    requestedThreads = 0;
+    pool = NULL;
+    useCompactScene = false;
+    compactScene = NULL;
+    compactFallback = false;
+    antialias = false;
+    spanRadius = DEFAULT_SPAN_RADIUS;
+    hashTiles = false;
+    topology = detectNumaTopology();
+    tilesX = 0;
+    tilesY = 0;
+    numSplitTiles = 0;
+    tileLists.start = NULL;
+    tileLists.cost = NULL;
+    tileLists.circles = NULL;
+    haveListsKey = false;
+    listsSubPixelCircles = 0;
+    listsCulledCircles = 0;
+    sceneHash = 0;
+    haveSceneHash = false;
+    listsSource = LISTS_BUILT;
+    haveFootprints = false;
+    rebuildFraction = DEFAULT_REBUILD_FRACTION;
+    binUpdate.rebuilt = true;
+    binUpdate.changedCircles = 0;
+    binUpdate.patchedTiles = 0;
+    binUpdate.time = 0.0;
+    numRebuilds = 0;
+    numUpdates = 0;
+}
+
+TiledRenderer::~TiledRenderer() {
+
+    if (image) {
+        delete image;
+    }
+
+    releaseScene();
+    delete compactScene;
+
+    delete pool;
+}
+
+const Image*
+TiledRenderer::getImage() {
+    return image;
+}
+
+// setup --
+//
+// Starts the worker threads.  Threads are assigned to NUMA nodes in
+// contiguous groups and pinned to the CPUs of their node (except
+// thread 0, the calling thread, which is only pinned while it works
+// for the renderer).  Then each node makes its own copy of the scene
+// and first-touches its band of the framebuffer.
+void
+TiledRenderer::setup() {
+
+    if (!pool)
+        pool = new WorkerPool(requestedThreads > 0 ? requestedThreads : numWorkerThreads());
+
+    int numThreads = pool->size();
+    int numNodes = topology.numNodes;
+
+    threadStats.assign(numThreads, ThreadStats());
+    threadNode.resize(numThreads);
+    for (int thread=0; thread<numThreads; thread++)
+        threadNode[thread] = std::min(numNodes - 1, thread * numNodes / numThreads);
+
+    if (numNodes > 1) {
+        pool->run([&](int thread) {
+            if (thread > 0)
+                pinCurrentThread(topology.nodeCpus[threadNode[thread]]);
+        });
+    }
+
+    replicateScene();
+
+    // a tuning profile may have changed the tile size since the image
+    // was allocated.  If the new image cannot be allocated the renderer
+    // is left without one, which the caller sees in getImage()
+    if (image && imageLayoutChanged()) {
+        int width = image->width;
+        int height = image->height;
+        if (allocOutputImage(image->allocatedWidth, image->allocatedHeight))
+            setRenderResolution(width, height);
+    }
+
+    if (image)
+        clearImage();
+}
+
+void
+TiledRenderer::printSetupInfo() {
+
+    int numNodes = topology.numNodes;
+    printf("Tiled renderer: %d threads, %dx%d tiles, %d NUMA node%s, %s framebuffer\n",
+           pool ? pool->size() : 0, tileSize, tileSize, numNodes, numNodes > 1 ? "s" : "",
+           image && image->tileSize ? "tiled" : "linear");
+
+    if (!compactScene)
+        return;
+
+    double floatBytes = static_cast<double>(numCircles) * 7 * sizeof(float);
+    double compactBytes = static_cast<double>(numCircles) * compactScene->bytesPerCircle();
+    printf("Compact scene: %.2f MB instead of %.2f MB (%.1fx), %s colors\n",
+           compactBytes / (1024 * 1024), floatBytes / (1024 * 1024),
+           compactBytes > 0.f ? floatBytes / compactBytes : 1.f,
+           compactScene->usesPalette() ? "palette" : "8-bit");
+    printf("Compact scene error: position %.3g (bound %.3g), radius %.3g (bound %.3g), color %.3g (bound %.3g)\n",
+           compactScene->positionError, compactScene->positionBound,
+           compactScene->radiusError, compactScene->radiusBound,
+           compactScene->colorError, compactScene->colorBound);
+    if (compactFallback)
+        fprintf(stderr, "Error: compact scene exceeds its error bound, using the float scene\n");
+}
+
+// runOnNodes --
+//
+// Runs a task on all pool threads, with thread 0 temporarily pinned to
+// its node like the other threads.
+void
+TiledRenderer::runOnNodes(const std::function<void(int)>& task) {
+
+    if (topology.numNodes == 1) {
+        pool->run(task);
+        return;
+    }
+
+    pool->run([&](int thread) {
+        if (thread == 0) {
+            ScopedThreadAffinity affinity(topology.nodeCpus[threadNode[0]]);
+            task(thread);
+        } else {
+            task(thread);
+        }
+    });
+}
+
+// replicateScene --
+//
+// Gives every NUMA node its own copy of the circle columns, allocated
+// and written by a thread of that node so that its pages are local.
+// On single node hosts the loaded arrays are used directly.
+void
+TiledRenderer::replicateScene() {
+
+    TRACE_ZONE("replicate scene");
+    freeSceneReplicas();
+
+    int numNodes = topology.numNodes;
+
+    SceneColumns loaded;
+    loaded.position = position;
+    loaded.color = color;
+    loaded.radius = radius;
+    loaded.compact = compactFallback ? NULL : compactScene;
+    nodeScene.assign(numNodes, loaded);
+
+    if (numNodes == 1 || !pool || numCircles == 0)
+        return;
+
+    runOnNodes([&](int thread) {
+        int node = threadNode[thread];
+        if (thread > 0 && threadNode[thread-1] == node)
+            return;
+
+        // first thread of the node.  In compact mode only the compact
+        // scene is read while rendering
+        SceneColumns replica;
+        replica.position = NULL;
+        replica.color = NULL;
+        replica.radius = NULL;
+        replica.compact = NULL;
+        if (loaded.compact) {
+            replica.compact = new CompactScene(*loaded.compact);
+        } else {
+            float* replicaPosition = new float[3 * numCircles];
+            float* replicaColor = new float[3 * numCircles];
+            float* replicaRadius = new float[numCircles];
+            std::copy(position, position + 3 * numCircles, replicaPosition);
+            std::copy(color, color + 3 * numCircles, replicaColor);
+            std::copy(radius, radius + numCircles, replicaRadius);
+            replica.position = replicaPosition;
+            replica.color = replicaColor;
+            replica.radius = replicaRadius;
+        }
+        nodeScene[node] = replica;
+    });
+}
+
+void
+TiledRenderer::freeSceneReplicas() {
+
+    for (size_t node=0; node<nodeScene.size(); node++) {
+        if (nodeScene[node].position != position) {
+            delete [] nodeScene[node].position;
+            delete [] nodeScene[node].color;
+            delete [] nodeScene[node].radius;
+        }
+        if (nodeScene[node].compact != compactScene)
+            delete nodeScene[node].compact;
+    }
+    nodeScene.clear();
+}
+
+// releaseScene --
+//
+// Drops the current scene, and frees its columns unless they belong to
+// the caller (setSceneColumns).
+void
+TiledRenderer::releaseScene() {
+
+    freeSceneReplicas();
+
+    if (ownsScene) {
+        delete [] position;
+        delete [] color;
+        delete [] radius;
+    }
+    numCircles = 0;
+    position = NULL;
+    color = NULL;
+    radius = NULL;
+    ownsScene = false;
+}
+
+// sceneChanged --
+//
+// Rebuilds what is derived from the scene columns: the compact scene,
+// and the per node copies once the threads exist.
+void
+TiledRenderer::sceneChanged() {
+
+    haveSceneHash = false;
+    haveListsKey = false;
+
+    if (useCompactScene) {
+        buildCompact();
+    } else {
+        delete compactScene;
+        compactScene = NULL;
+    }
+    if (pool)
+        replicateScene();
+}
+
+// buildCompact --
+//
+// Quantizes the loaded scene.  Falls back to the float scene if the
+// decoding error is out of bounds (printSetupInfo reports both).
+void
+TiledRenderer::buildCompact() {
+
+    TRACE_ZONE("compact scene");
+    delete compactScene;
+    compactScene = new CompactScene();
+
+    compactFallback = !buildCompactScene(numCircles, position, color, radius, *compactScene);
+}
+
+// pixelNode --
+//
+// NUMA node that owns the pixel at the given offset in the framebuffer.
+// The allocated buffer is split in equal contiguous bands, one per node.
+int
+TiledRenderer::pixelNode(long long pixelOffset) const {
+
+    long long allocatedPixels = static_cast<long long>(image->allocatedPixels());
+    int node = static_cast<int>(pixelOffset * topology.numNodes / allocatedPixels);
+    return std::min(node, topology.numNodes - 1);
+}
+
+// imageLayoutChanged --
+//
+// Our own image is not stored with the layout asked for (setTiledLayout,
+// with the current tile size).
+bool
+TiledRenderer::imageLayoutChanged() const {
+
+    return image->ownsPixels() && image->tileSize != (tiledLayout ? tileSize : 0);
+}
+
+void
+TiledRenderer::setTileSize(int size) {
+    tileSize = std::max(size, 1);
+}
+
+void
+TiledRenderer::setTiledLayout(bool tiled) {
+    tiledLayout = tiled;
+}
+
+void
+TiledRenderer::setBinCacheDir(const char* directory) {
+    binCacheDir = directory ? directory : "";
+    haveListsKey = false;
+    haveFootprints = false;
+}
+
+void
+TiledRenderer::setRebuildFraction(float fraction) {
+    rebuildFraction = std::max(fraction, 0.f);
+}
+
+void
+TiledRenderer::setSpanRadius(float pixels) {
+    spanRadius = std::max(pixels, 0.f);
+}
+
+std::string
+TiledRenderer::tuningSignature() const {
+    return tuningSceneSignature(numCircles, radius, image->width, image->height, antialias, useCompactScene);
+}
+
+bool
+TiledRenderer::setAntialias(bool enable) {
+    antialias = enable;
+    return true;
+}
+
+void
+TiledRenderer::setCompactScene(bool compact) {
+
+    useCompactScene = compact;
+    if (numCircles == 0)
+        return;
+
+    freeSceneReplicas();
+    sceneChanged();
+}
+
+void
+TiledRenderer::setNumThreads(int numThreads) {
+    requestedThreads = std::max(numThreads, 0);
+}
+
+// allocOutputImage --
+//
+// Allocate buffer the renderer will render into.  An image of the
+// right size is kept as is; otherwise the old one goes back to the
+// framebuffer pool first.  Returns false if the pool has no memory for
+// the new one.
+bool
+TiledRenderer::allocOutputImage(int width, int height) {
+
+    if (image && image->ownsPixels() && image->allocatedWidth == width && image->allocatedHeight == height &&
+        !imageLayoutChanged())
+        return setRenderResolution(width, height);
+
+    if (image)
+        delete image;
+
+    // on NUMA hosts the pages are placed by clearImage, from the
+    // threads of the node that owns them
+    image = new Image(width, height, topology.numNodes == 1, tiledLayout ? tileSize : 0);
+    if (!image->data) {
+        delete image;
+        image = NULL;
+        return false;
+    }
+
+    if (pool)
+        clearImage();
+    return true;
+}
+
+// setOutputBuffer --
+//
+// Renders into the caller's pixels from now on.  The previous image
+// goes back to the framebuffer pool.  The caller's pages are where the
+// caller placed them, NUMA placement only applies to our own images.
+bool
+TiledRenderer::setOutputBuffer(float* data, int width, int height) {
+
+    if (image)
+        delete image;
+    image = new Image(width, height, data);
+    return true;
+}
+
+bool
+TiledRenderer::setRenderResolution(int width, int height) {
+    return image && image->resize(width, height);
+}
+
+// clearImage --
+//
+// Clear's the renderer's target image.  Every node clears its own band
+// of the framebuffer, split evenly between the node's threads.
+void
+TiledRenderer::clearImage() {
+
+    TRACE_ZONE("clear");
+
+    if (!pool) {
+        image->clear(1.f, 1.f, 1.f, 1.f);
+        return;
+    }
+
+    long long numPixels = static_cast<long long>(image->storedPixels());
+    long long allocatedPixels = static_cast<long long>(image->allocatedPixels());
+    int numNodes = topology.numNodes;
+
+    runOnNodes([&](int thread) {
+
+        TRACE_ZONE_ARG("clear band", "thread", thread);
+
+        int node = threadNode[thread];
+        int firstThread = thread;
+        while (firstThread > 0 && threadNode[firstThread-1] == node)
+            firstThread--;
+        int lastThread = thread;
+        while (lastThread + 1 < pool->size() && threadNode[lastThread+1] == node)
+            lastThread++;
+
+        long long nodeStart = allocatedPixels * node / numNodes;
+        long long nodeEnd = allocatedPixels * (node + 1) / numNodes;
+        int nodeThreads = lastThread - firstThread + 1;
+        int rank = thread - firstThread;
+
+        long long start = std::min(numPixels, nodeStart + (nodeEnd - nodeStart) * rank / nodeThreads);
+        long long end = std::min(numPixels, nodeStart + (nodeEnd - nodeStart) * (rank + 1) / nodeThreads);
+
+        float* ptr = &image->data[4 * start];
+        for (long long i=start; i<end; i++) {
+            ptr[0] = 1.f;
+            ptr[1] = 1.f;
+            ptr[2] = 1.f;
+            ptr[3] = 1.f;
+            ptr += 4;
+        }
+    });
+}
+
+// clearRegion --
+//
+// Clears the rows of the rectangle only, split evenly between the
+// threads.
+void
+TiledRenderer::clearRegion(int minX, int minY, int maxX, int maxY) {
+
+    TRACE_ZONE("clear");
+
+    if (!pool) {
+        image->clearRect(minX, minY, maxX, maxY, 1.f, 1.f, 1.f, 1.f);
+        return;
+    }
+
+    int numThreads = pool->size();
+
+    runOnNodes([&](int thread) {
+        int rowMin = minY + (maxY - minY) * thread / numThreads;
+        int rowMax = minY + (maxY - minY) * (thread + 1) / numThreads;
+        image->clearRect(minX, rowMin, maxX, rowMax, 1.f, 1.f, 1.f, 1.f);
+    });
+}
+
+void
+TiledRenderer::loadScene(SceneName scene) {
+
+    releaseScene();
+
+    float* loadedPosition;
+    float* loadedColor;
+    float* loadedRadius;
+    sceneName = scene;
+    loadCircleScene(sceneName, numCircles, loadedPosition, loadedColor, loadedRadius);
+
+    position = loadedPosition;
+    color = loadedColor;
+    radius = loadedRadius;
+    ownsScene = true;
+    sceneChanged();
+}
+
+bool
+TiledRenderer::setSceneColumns(int circles, const float* circlePosition, const float* circleColor, const float* circleRadius) {
+
+    releaseScene();
+
+    numCircles = circles;
+    position = circlePosition;
+    color = circleColor;
+    radius = circleRadius;
+    sceneChanged();
+    return true;
+}
+
+void
+TiledRenderer::render() {
+    renderRegion(0, 0, image->width, image->height);
+}
+
+void
+TiledRenderer::renderRegion(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    regionMinX = CLAMP(regionMinX, 0, image->width);
+    regionMaxX = CLAMP(regionMaxX, 0, image->width);
+    regionMinY = CLAMP(regionMinY, 0, image->height);
+    regionMaxY = CLAMP(regionMaxY, 0, image->height);
+
+    if (!pool)
+        setup();
+
+    for (size_t i=0; i<threadStats.size(); i++) {
+        threadStats[i].binTime = 0.f;
+        threadStats[i].busyTime = 0.f;
+        threadStats[i].itemsDone = 0;
+        threadStats[i].itemsStolen = 0;
+        threadStats[i].localBytes = 0.f;
+        threadStats[i].remoteBytes = 0.f;
+        threadStats[i].sceneBytes = 0.f;
+        threadStats[i].subPixelCircles = 0;
+        threadStats[i].spanRows = 0;
+        threadStats[i].culledCircles = 0;
+    }
+
+    if (regionMinX >= regionMaxX || regionMinY >= regionMaxY) {
+        workItems.clear();
+        if (hashTiles)
+            hashFrameTiles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+        return;
+    }
+
+    prepareTileLists(regionMinX, regionMinY, regionMaxX, regionMaxY);
+    scheduleTiles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+    compositeTiles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+
+    if (hashTiles)
+        hashFrameTiles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+}
+
+bool
+TiledRenderer::enableTileHashes(int size) {
+    hashTiles = (size == tileSize);
+    return hashTiles;
+}
+
+const uint64_t*
+TiledRenderer::getTileHashes() {
+    return hashTiles && !tileHashes.empty() ? &tileHashes[0] : NULL;
+}
+
+// hashFrameTiles --
+//
+// Completes the tile hashes of the frame.  The pixels of every work
+// item were hashed by the thread that rendered it, right after
+// rendering it; here the item hashes are summed per tile, and the
+// tiles that were not entirely rendered this frame (no circles, or
+// partly outside the region) are hashed from the framebuffer.
+void
+TiledRenderer::hashFrameTiles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    TRACE_ZONE("hash tiles");
+    int width = image->width;
+    int height = image->height;
+    int gridX = tileGridSize(width, tileSize);
+    int numTiles = gridX * tileGridSize(height, tileSize);
+
+    tileHashes.assign(numTiles, 0);
+    std::vector<char> complete(numTiles, 0);
+
+    for (size_t i=0; i<workItems.size(); i++) {
+        tileHashes[workItems[i].tile] += itemHashes[i];
+        complete[workItems[i].tile] = 1;
+    }
+
+    std::vector<int> remaining;
+    for (int tile=0; tile<numTiles; tile++) {
+        int minX = (tile % gridX) * tileSize;
+        int minY = (tile / gridX) * tileSize;
+        int maxX = std::min(minX + tileSize, width);
+        int maxY = std::min(minY + tileSize, height);
+        bool inRegion = minX >= regionMinX && minY >= regionMinY && maxX <= regionMaxX && maxY <= regionMaxY;
+        if (!complete[tile] || !inRegion)
+            remaining.push_back(tile);
+    }
+
+    pool->run([&](int thread) {
+        for (size_t i=thread; i<remaining.size(); i+=pool->size()) {
+            int tile = remaining[i];
+            int minX = (tile % gridX) * tileSize;
+            int minY = (tile / gridX) * tileSize;
+            tileHashes[tile] = hashPixelRect(image, minX, minY,
+                                             std::min(minX + tileSize, width), std::min(minY + tileSize, height));
+        }
+    });
+}
+
+// prepareTileLists --
+//
+// Points tileLists at the tile lists of the region.  Without a bin
+// cache the circles are binned.  With one, the lists of the previous
+// frame are kept if their key did not change, otherwise they are mapped
+// from the cache file of the key, or binned and saved to that file.
+void
+TiledRenderer::prepareTileLists(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    if (binCacheDir.empty()) {
+        updateTileLists(regionMinX, regionMinY, regionMaxX, regionMaxY);
+        listsSource = LISTS_BUILT;
+        return;
+    }
+
+    TRACE_ZONE("bin cache");
+    double startTime = CycleTimer::currentSeconds();
+
+    if (!haveSceneHash) {
+        sceneHash = hashSceneGeometry(numCircles, position, radius);
+        haveSceneHash = true;
+    }
+
+    BinCacheKey key = tileListsKey(regionMinX, regionMinY, regionMaxX, regionMaxY);
+    key.sceneHash = sceneHash;
+
+    if (haveListsKey && key == listsKey) {
+        listsSource = LISTS_REUSED;
+    } else {
+        tilesX = tileGridSize(key.width, tileSize);
+        tilesY = tileGridSize(key.height, tileSize);
+        std::string filename = binCacheFilename(binCacheDir, key);
+
+        if (binCacheFile.open(filename, key)) {
+            tileLists.start = binCacheFile.tileStart;
+            tileLists.cost = binCacheFile.tileCost;
+            tileLists.circles = binCacheFile.tileCircles;
+            listsSubPixelCircles = binCacheFile.header->subPixelCircles;
+            listsCulledCircles = binCacheFile.header->culledCircles;
+            listsSource = LISTS_MAPPED;
+            haveFootprints = false;
+        } else {
+            binCacheFile.close();
+            binCircles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+            listsSubPixelCircles = 0;
+            listsCulledCircles = 0;
+            for (size_t i=0; i<threadStats.size(); i++) {
+                listsSubPixelCircles += threadStats[i].subPixelCircles;
+                listsCulledCircles += threadStats[i].culledCircles;
+            }
+            bool saved = BinCacheFile::write(filename, key, tilesX * tilesY, tileLists.start, tileLists.cost,
+                                             tileLists.circles, listsSubPixelCircles, listsCulledCircles);
+            listsSource = saved ? LISTS_SAVED : LISTS_NOT_SAVED;
+        }
+        listsKey = key;
+        haveListsKey = true;
+    }
+
+    // the counts of the pass that built the lists are reported
+    // for every frame that uses them
+    if (listsSource == LISTS_MAPPED || listsSource == LISTS_REUSED) {
+        threadStats[0].subPixelCircles = listsSubPixelCircles;
+        threadStats[0].culledCircles = listsCulledCircles;
+        threadStats[0].binTime += CycleTimer::currentSeconds() - startTime;
+    }
+}
+
+// tileListsKey --
+//
+// Everything but the scene that the tile lists of the region depend on.
+BinCacheKey
+TiledRenderer::tileListsKey(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const {
+
+    BinCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.numCircles = numCircles;
+    key.width = image->width;
+    key.height = image->height;
+    key.tileSize = tileSize;
+    key.regionMinX = regionMinX;
+    key.regionMinY = regionMinY;
+    key.regionMaxX = regionMaxX;
+    key.regionMaxY = regionMaxY;
+    key.flags = (antialias ? BIN_CACHE_ANTIALIAS : 0) | (nodeScene[0].compact ? BIN_CACHE_COMPACT : 0);
+    return key;
+}
+
+// updateTileLists --
+//
+// Brings the tile lists of the previous frame up to date with the
+// scene.  Every thread recomputes the footprint of its range of circles
+// and keeps those that changed; their cost estimate is moved to the
+// tiles they cover now.  If few enough circles changed tiles, only the
+// lists of the tiles they left or entered are patched, otherwise (or
+// if the binning parameters changed) all the lists are rebuilt.
+void
+TiledRenderer::updateTileLists(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    TRACE_ZONE("bin update");
+    double startTime = CycleTimer::currentSeconds();
+    BinCacheKey key = tileListsKey(regionMinX, regionMinY, regionMaxX, regionMaxY);
+
+    if (!haveFootprints || !(key == footprintKey) || rebuildFraction <= 0.f) {
+        binCircles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+        binUpdate.rebuilt = true;
+        binUpdate.changedCircles = -1;
+        binUpdate.patchedTiles = tilesX * tilesY;
+        binUpdate.time = CycleTimer::currentSeconds() - startTime;
+        numRebuilds++;
+        return;
+    }
+
+    int width = image->width;
+    int height = image->height;
+    int numThreads = pool->size();
+    int numTiles = tilesX * tilesY;
+    int circlesPerThread = (numCircles + numThreads - 1) / numThreads;
+
+    movedCircles.resize(numThreads);
+    chunkTileCost.assign(numThreads * numTiles, 0.f);
+    std::vector<int> changedCount(numThreads, 0);
+    std::vector<int> culledCount(numThreads, 0);
+    std::vector<int> subPixelCount(numThreads, 0);
+
+    runOnNodes([&](int thread) {
+
+        TRACE_ZONE_ARG("bin compare", "thread", thread);
+        double threadStart = CycleTimer::currentSeconds();
+
+        const SceneColumns& scene = nodeScene[threadNode[thread]];
+        std::vector<std::pair<int, CircleFootprint> >& moved = movedCircles[thread];
+        float* costs = &chunkTileCost[thread * numTiles];
+        int circleStart = std::min(numCircles, thread * circlesPerThread);
+        int circleEnd = std::min(numCircles, circleStart + circlesPerThread);
+
+        moved.clear();
+        for (int circleIndex=circleStart; circleIndex<circleEnd; circleIndex++) {
+
+            CircleFootprint footprint = circleFootprint(scene, circleIndex, antialias, width, height,
+                                                        regionMinX, regionMinY, regionMaxX, regionMaxY);
+            if (footprint.flags & FOOTPRINT_CULLED)
+                culledCount[thread]++;
+            else if (footprint.flags & FOOTPRINT_SUBPIXEL)
+                subPixelCount[thread]++;
+
+            const CircleFootprint& previous = footprints[circleIndex];
+            if (footprint == previous)
+                continue;
+
+            addFootprintCost(previous, tileSize, tilesX, -1.f, costs);
+            addFootprintCost(footprint, tileSize, tilesX, 1.f, costs);
+            if (!sameTiles(footprint, previous, tileSize))
+                changedCount[thread]++;
+            moved.push_back(std::make_pair(circleIndex, footprint));
+        }
+
+        threadStats[thread].binTime += CycleTimer::currentSeconds() - threadStart;
+    });
+
+    int numChanged = 0;
+    for (int thread=0; thread<numThreads; thread++)
+        numChanged += changedCount[thread];
+
+    if (numChanged > rebuildFraction * numCircles) {
+        binCircles(regionMinX, regionMinY, regionMaxX, regionMaxY);
+        binUpdate.rebuilt = true;
+        binUpdate.patchedTiles = numTiles;
+        numRebuilds++;
+    } else {
+        // costs only ever move between tiles, rounding must not make
+        // them negative
+        for (int tile=0; tile<numTiles; tile++) {
+            float cost = tileCost[tile];
+            for (int thread=0; thread<numThreads; thread++)
+                cost += chunkTileCost[thread * numTiles + tile];
+            tileCost[tile] = std::max(cost, 0.f);
+        }
+        for (int thread=0; thread<numThreads; thread++) {
+            threadStats[thread].culledCircles += culledCount[thread];
+            threadStats[thread].subPixelCircles += subPixelCount[thread];
+        }
+        patchTileLists();
+        numUpdates++;
+    }
+    binUpdate.changedCircles = numChanged;
+    binUpdate.time = CycleTimer::currentSeconds() - startTime;
+}
+
+// patchTileLists --
+//
+// Removes the circles that changed tiles from the lists of their old
+// tiles and merges them into the lists of their new ones.  Changes are
+// gathered per tile in circle order (the moved circles of every thread
+// are in circle order, and the threads' ranges follow each other), so
+// each patched list is a single merge of its old list with its
+// changes, which keeps the depth order.  Lists without changes are
+// copied as they are.
+void
+TiledRenderer::patchTileLists() {
+
+    TRACE_ZONE("bin patch");
+    int numThreads = pool->size();
+    int numTiles = tilesX * tilesY;
+
+    // a change is the entry of a circle entering the tile, or the
+    // circle index with REMOVED_ENTRY set for a circle leaving it
+    const int REMOVED_ENTRY = 0x40000000;
+    std::vector<int> changeStart(numTiles + 1, 0);
+    std::vector<int> countDelta(numTiles, 0);
+
+    auto forEachChange = [&](auto visit) {
+        for (int thread=0; thread<numThreads; thread++) {
+            const std::vector<std::pair<int, CircleFootprint> >& moved = movedCircles[thread];
+            for (size_t i=0; i<moved.size(); i++) {
+                int circleIndex = moved[i].first;
+                const CircleFootprint& previous = footprints[circleIndex];
+                const CircleFootprint& current = moved[i].second;
+                if (sameTiles(current, previous, tileSize))
+                    continue;
+
+                // removals first, the merge expects them before an
+                // addition of the same circle
+                if (!(previous.flags & FOOTPRINT_CULLED))
+                    for (int tileY=previous.minY/tileSize; tileY<=(previous.maxY-1)/tileSize; tileY++)
+                        for (int tileX=previous.minX/tileSize; tileX<=(previous.maxX-1)/tileSize; tileX++)
+                            visit(tileY * tilesX + tileX, circleIndex | REMOVED_ENTRY, true);
+
+                int entry = (current.flags & FOOTPRINT_SUBPIXEL) ? static_cast<int>(circleIndex | SUBPIXEL_CIRCLE_FLAG)
+                                                                  : circleIndex;
+                if (!(current.flags & FOOTPRINT_CULLED))
+                    for (int tileY=current.minY/tileSize; tileY<=(current.maxY-1)/tileSize; tileY++)
+                        for (int tileX=current.minX/tileSize; tileX<=(current.maxX-1)/tileSize; tileX++)
+                            visit(tileY * tilesX + tileX, entry, false);
+            }
+        }
+    };
+
+    forEachChange([&](int tile, int entry, bool removal) {
+        changeStart[tile + 1]++;
+        countDelta[tile] += removal ? -1 : 1;
+    });
+    for (int tile=0; tile<numTiles; tile++)
+        changeStart[tile + 1] += changeStart[tile];
+
+    std::vector<int> changes(changeStart[numTiles]);
+    std::vector<int> changeOffset(changeStart.begin(), changeStart.end() - 1);
+    forEachChange([&](int tile, int entry, bool removal) {
+        changes[changeOffset[tile]++] = entry;
+    });
+
+    patchedStart.resize(numTiles + 1);
+    int offset = 0;
+    int patchedTiles = 0;
+    for (int tile=0; tile<numTiles; tile++) {
+        patchedStart[tile] = offset;
+        offset += tileStart[tile + 1] - tileStart[tile] + countDelta[tile];
+        if (changeStart[tile + 1] > changeStart[tile])
+            patchedTiles++;
+    }
+    patchedStart[numTiles] = offset;
+    patchedCircles.resize(offset);
+
+    int tilesPerThread = (numTiles + numThreads - 1) / numThreads;
+    pool->run([&](int thread) {
+
+        int firstTile = std::min(numTiles, thread * tilesPerThread);
+        int lastTile = std::min(numTiles, firstTile + tilesPerThread);
+
+        for (int tile=firstTile; tile<lastTile; tile++) {
+
+            const int* old = tileCircles.data() + tileStart[tile];
+            const int* oldEnd = tileCircles.data() + tileStart[tile + 1];
+            int* out = patchedCircles.data() + patchedStart[tile];
+
+            if (changeStart[tile] == changeStart[tile + 1]) {
+                std::copy(old, oldEnd, out);
+                continue;
+            }
+
+            // both are sorted by circle, a removal always finds its
+            // circle in the old list
+            const int* change = &changes[changeStart[tile]];
+            const int* changeEnd = change + (changeStart[tile + 1] - changeStart[tile]);
+            for (; change<changeEnd; change++) {
+                bool removal = (*change & ~SUBPIXEL_CIRCLE_FLAG) & REMOVED_ENTRY;
+                int changeCircle = static_cast<int>(*change & ~(SUBPIXEL_CIRCLE_FLAG | REMOVED_ENTRY));
+                while (old < oldEnd && static_cast<int>(*old & ~SUBPIXEL_CIRCLE_FLAG) < changeCircle)
+                    *out++ = *old++;
+                if (removal)
+                    old++;
+                else
+                    *out++ = *change;
+            }
+            std::copy(old, oldEnd, out);
+        }
+    });
+
+    tileStart.swap(patchedStart);
+    tileCircles.swap(patchedCircles);
+    tileLists.start = &tileStart[0];
+    tileLists.cost = &tileCost[0];
+    tileLists.circles = tileCircles.data();
+
+    for (int thread=0; thread<numThreads; thread++)
+        for (size_t i=0; i<movedCircles[thread].size(); i++)
+            footprints[movedCircles[thread][i].first] = movedCircles[thread][i].second;
+
+    binUpdate.rebuilt = false;
+    binUpdate.patchedTiles = patchedTiles;
+}
+
+// binCircles --
+//
+// Builds the depth ordered circle list of every tile that intersects
+// the region, and estimates the cost of every tile.  Thread i handles
+// the i-th contiguous range of circles: it first counts its circles per
+// tile, then (after a prefix sum over tiles and threads) writes them at
+// its own offset in each tile list, after the circles of all the
+// threads with lower indexes.
+void
+TiledRenderer::binCircles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    TRACE_ZONE("bin");
+    int width = image->width;
+    int height = image->height;
+    int numThreads = pool->size();
+
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    int numTiles = tilesX * tilesY;
+
+    chunkTileCount.assign(numThreads * numTiles, 0);
+    chunkTileCost.assign(numThreads * numTiles, 0.f);
+    tileStart.resize(numTiles + 1);
+    tileCost.resize(numTiles);
+
+    int circlesPerThread = (numCircles + numThreads - 1) / numThreads;
+
+    runOnNodes([&](int thread) {
+
+        TRACE_ZONE_ARG("bin count", "thread", thread);
+        double startTime = CycleTimer::currentSeconds();
+
+        const SceneColumns& scene = nodeScene[threadNode[thread]];
+        ThreadStats& stats = threadStats[thread];
+        int* counts = &chunkTileCount[thread * numTiles];
+        float* costs = &chunkTileCost[thread * numTiles];
+        int circleStart = std::min(numCircles, thread * circlesPerThread);
+        int circleEnd = std::min(numCircles, circleStart + circlesPerThread);
+
+        for (int circleIndex=circleStart; circleIndex<circleEnd; circleIndex++) {
+
+            float px, py, rad;
+            circleGeometry(scene, circleIndex, px, py, rad);
+
+            // anti-aliased circles also cover the pixels just outside
+            // their edge
+            float reach = antialias ? rad + coverageReach(width) : rad;
+
+            int screenMinX, screenMinY, screenMaxX, screenMaxY;
+            if (rad <= 0.f ||
+                !circleScreenBox(px, py, reach,
+                                 width, height, regionMinX, regionMinY, regionMaxX, regionMaxY,
+                                 screenMinX, screenMinY, screenMaxX, screenMaxY)) {
+                stats.culledCircles++;
+                continue;
+            }
+
+            bool subPixel = !antialias && isSubPixelCircle(rad, width, height);
+            if (subPixel)
+                stats.subPixelCircles++;
+
+            for (int tileY=screenMinY/tileSize; tileY<=(screenMaxY-1)/tileSize; tileY++) {
+                int spanY = std::min(screenMaxY, (tileY+1) * tileSize) - std::max(screenMinY, tileY * tileSize);
+                for (int tileX=screenMinX/tileSize; tileX<=(screenMaxX-1)/tileSize; tileX++) {
+                    int spanX = std::min(screenMaxX, (tileX+1) * tileSize) - std::max(screenMinX, tileX * tileSize);
+                    int tile = tileY * tilesX + tileX;
+                    counts[tile]++;
+                    costs[tile] += subPixel ? SUBPIXEL_CIRCLE_COST : CIRCLE_SETUP_COST + static_cast<float>(spanX * spanY);
+                }
+            }
+        }
+
+        threadStats[thread].binTime += CycleTimer::currentSeconds() - startTime;
+    });
+
+    // exclusive scan over (tile, thread): chunkTileCount becomes the
+    // offset at which each thread writes its circles of each tile
+    int offset = 0;
+    for (int tile=0; tile<numTiles; tile++) {
+        tileStart[tile] = offset;
+        float cost = 0.f;
+        for (int thread=0; thread<numThreads; thread++) {
+            int count = chunkTileCount[thread * numTiles + tile];
+            chunkTileCount[thread * numTiles + tile] = offset;
+            offset += count;
+            cost += chunkTileCost[thread * numTiles + tile];
+        }
+        tileCost[tile] = cost;
+    }
+    tileStart[numTiles] = offset;
+    tileCircles.resize(offset);
+    footprints.resize(numCircles);
+
+    tileLists.start = &tileStart[0];
+    tileLists.cost = &tileCost[0];
+    tileLists.circles = tileCircles.data();
+    haveListsKey = false;
+
+    runOnNodes([&](int thread) {
+
+        TRACE_ZONE_ARG("bin fill", "thread", thread);
+        double startTime = CycleTimer::currentSeconds();
+
+        const SceneColumns& scene = nodeScene[threadNode[thread]];
+        int* offsets = &chunkTileCount[thread * numTiles];
+        int circleStart = std::min(numCircles, thread * circlesPerThread);
+        int circleEnd = std::min(numCircles, circleStart + circlesPerThread);
+
+        for (int circleIndex=circleStart; circleIndex<circleEnd; circleIndex++) {
+
+            // footprints are kept for the incremental update of the next
+            // frame (updateTileLists)
+            CircleFootprint footprint = circleFootprint(scene, circleIndex, antialias, width, height,
+                                                        regionMinX, regionMinY, regionMaxX, regionMaxY);
+            footprints[circleIndex] = footprint;
+            if (footprint.flags & FOOTPRINT_CULLED)
+                continue;
+
+            int entry = circleIndex;
+            if (footprint.flags & FOOTPRINT_SUBPIXEL)
+                entry = static_cast<int>(entry | SUBPIXEL_CIRCLE_FLAG);
+
+            for (int tileY=footprint.minY/tileSize; tileY<=(footprint.maxY-1)/tileSize; tileY++)
+                for (int tileX=footprint.minX/tileSize; tileX<=(footprint.maxX-1)/tileSize; tileX++)
+                    tileCircles[offsets[tileY * tilesX + tileX]++] = entry;
+        }
+
+        threadStats[thread].binTime += CycleTimer::currentSeconds() - startTime;
+    });
+
+    footprintKey = tileListsKey(regionMinX, regionMinY, regionMaxX, regionMaxY);
+    haveFootprints = true;
+}
+
+// scheduleTiles --
+//
+// Builds the work items of the frame: one per non-empty tile, with
+// tiles that would take a large share of a thread's fair amount of work
+// split in quadrants until they are small enough.  Items are sorted by
+// decreasing estimated cost.
+void
+TiledRenderer::scheduleTiles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    TRACE_ZONE("schedule");
+    workItems.clear();
+    numSplitTiles = 0;
+
+    int firstTileX = regionMinX / tileSize;
+    int lastTileX = (regionMaxX - 1) / tileSize;
+    int firstTileY = regionMinY / tileSize;
+    int lastTileY = (regionMaxY - 1) / tileSize;
+
+    float totalCost = 0.f;
+    for (int tileY=firstTileY; tileY<=lastTileY; tileY++)
+        for (int tileX=firstTileX; tileX<=lastTileX; tileX++)
+            totalCost += tileLists.cost[tileY * tilesX + tileX];
+
+    float splitCost = SPLIT_COST_FRACTION * totalCost / pool->size();
+
+    std::vector<WorkItem> pending;
+
+    for (int tileY=firstTileY; tileY<=lastTileY; tileY++) {
+        for (int tileX=firstTileX; tileX<=lastTileX; tileX++) {
+
+            int tile = tileY * tilesX + tileX;
+            if (tileLists.start[tile] == tileLists.start[tile+1])
+                continue;
+
+            WorkItem item;
+            item.tile = tile;
+            item.minX = std::max(tileX * tileSize, regionMinX);
+            item.minY = std::max(tileY * tileSize, regionMinY);
+            item.maxX = std::min((tileX+1) * tileSize, regionMaxX);
+            item.maxY = std::min((tileY+1) * tileSize, regionMaxY);
+            item.cost = tileLists.cost[tile];
+
+            if (item.cost > splitCost)
+                numSplitTiles++;
+
+            pending.push_back(item);
+            while (!pending.empty()) {
+
+                WorkItem current = pending.back();
+                pending.pop_back();
+
+                int sizeX = current.maxX - current.minX;
+                int sizeY = current.maxY - current.minY;
+
+                if (current.cost <= splitCost || (sizeX <= MIN_SUBTILE_SIZE && sizeY <= MIN_SUBTILE_SIZE)) {
+                    workItems.push_back(current);
+                    continue;
+                }
+
+                // quadrants (halves if one side is already minimal); the
+                // cost is assumed to be spread evenly over the pixels
+                int midX = (sizeX > MIN_SUBTILE_SIZE) ? current.minX + sizeX / 2 : current.maxX;
+                int midY = (sizeY > MIN_SUBTILE_SIZE) ? current.minY + sizeY / 2 : current.maxY;
+                int xs[3] = { current.minX, midX, current.maxX };
+                int ys[3] = { current.minY, midY, current.maxY };
+                float area = static_cast<float>(sizeX * sizeY);
+
+                for (int j=0; j<2; j++) {
+                    for (int i=0; i<2; i++) {
+                        if (xs[i] >= xs[i+1] || ys[j] >= ys[j+1])
+                            continue;
+                        WorkItem sub = current;
+                        sub.minX = xs[i];
+                        sub.maxX = xs[i+1];
+                        sub.minY = ys[j];
+                        sub.maxY = ys[j+1];
+                        sub.cost = current.cost * (xs[i+1] - xs[i]) * (ys[j+1] - ys[j]) / area;
+                        pending.push_back(sub);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(workItems.begin(), workItems.end(), [](const WorkItem& a, const WorkItem& b) {
+        return a.cost > b.cost;
+    });
+}
+
+// compositeTiles --
+//
+// Work items are dealt round robin, most expensive first, to the
+// deques of the threads of the node that owns the item's pixels.  Each
+// thread works through its own deque from the front; once it is empty
+// it steals the cheapest remaining items from the back of the other
+// threads' deques, trying the threads of its own node first.
+void
+TiledRenderer::compositeTiles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    int numThreads = pool->size();
+    int numNodes = topology.numNodes;
+    std::vector<WorkDeque> deques(numThreads);
+
+    // threads of every node, and where the next item of the node goes
+    std::vector<std::vector<int> > nodeThreads(numNodes);
+    for (int thread=0; thread<numThreads; thread++)
+        nodeThreads[threadNode[thread]].push_back(thread);
+    std::vector<int> nextThread(numNodes, 0);
+
+    // item pixels are hashed while they are still in cache
+    itemHashes.resize(workItems.size());
+    auto hashItem = [&](int item) {
+        const WorkItem& work = workItems[item];
+        itemHashes[item] = hashPixelRect(image, work.minX, work.minY, work.maxX, work.maxY);
+    };
+
+    for (size_t i=0; i<workItems.size(); i++) {
+        const WorkItem& item = workItems[i];
+        int node = pixelNode(static_cast<long long>(image->pixelIndex(item.minX, item.minY)));
+        if (nodeThreads[node].empty())
+            node = 0;
+        std::vector<int>& threads = nodeThreads[node];
+        int thread = threads[nextThread[node]++ % threads.size()];
+        deques[thread].items.push_back(static_cast<int>(i));
+    }
+
+    runOnNodes([&](int thread) {
+
+        TRACE_ZONE_ARG("composite", "thread", thread);
+        double startTime = CycleTimer::currentSeconds();
+        ThreadStats& stats = threadStats[thread];
+        int node = threadNode[thread];
+
+        // steal order: threads of the same node, then all the others
+        std::vector<int> victims;
+        for (int i=1; i<numThreads; i++) {
+            int victim = (thread + i) % numThreads;
+            if (threadNode[victim] == node)
+                victims.push_back(victim);
+        }
+        for (int i=1; i<numThreads; i++) {
+            int victim = (thread + i) % numThreads;
+            if (threadNode[victim] != node)
+                victims.push_back(victim);
+        }
+
+        int item;
+        while (true) {
+            if (deques[thread].popFront(item)) {
+                TRACE_ZONE_ARG("tile", "tile", workItems[item].tile);
+                renderItem(workItems[item], thread, regionMinX, regionMinY, regionMaxX, regionMaxY);
+                if (hashTiles)
+                    hashItem(item);
+                stats.itemsDone++;
+                continue;
+            }
+
+            bool stolen = false;
+            for (size_t i=0; i<victims.size() && !stolen; i++)
+                stolen = deques[victims[i]].stealBack(item);
+            if (!stolen)
+                break;
+
+            TRACE_ZONE_ARG("stolen tile", "tile", workItems[item].tile);
+            renderItem(workItems[item], thread, regionMinX, regionMinY, regionMaxX, regionMaxY);
+            if (hashTiles)
+                hashItem(item);
+            stats.itemsDone++;
+            stats.itemsStolen++;
+        }
+
+        stats.busyTime += CycleTimer::currentSeconds() - startTime;
+    });
+}
+
+// renderItem --
+//
+// Composites the circles of a tile, in depth order, into the pixels of
+// the work item.  The per pixel math is the same as in
+// RefRenderer::shadePixel.
+void
+TiledRenderer::renderItem(const WorkItem& item, int thread, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) {
+
+    int width = image->width;
+    int height = image->height;
+    float invWidth = 1.f / width;
+    float invHeight = 1.f / height;
+
+    int node = threadNode[thread];
+    const SceneColumns& scene = nodeScene[node];
+    size_t circleBytes = scene.compact ? scene.compact->bytesPerCircle() : 7 * sizeof(float);
+
+    ThreadStats& stats = threadStats[thread];
+    double pixelBytes = 2.0 * sizeof(float) * 4 * (item.maxX - item.minX) * (item.maxY - item.minY);
+    if (pixelNode(static_cast<long long>(image->pixelIndex(item.minX, item.minY))) == node)
+        stats.localBytes += pixelBytes;
+    else
+        stats.remoteBytes += pixelBytes;
+    const int* lists = tileLists.start;
+    stats.sceneBytes += static_cast<double>(lists[item.tile+1] - lists[item.tile]) * (sizeof(int) + circleBytes);
+
+    // the item lies within one tile, so its rows are rowStride pixels
+    // apart in either framebuffer layout
+    float* itemPixels = &image->data[4 * image->pixelIndex(item.minX, item.minY)];
+    size_t rowStride = image->tileSize ? image->tileSize : width;
+
+    for (int i=lists[item.tile]; i<lists[item.tile+1]; i++) {
+
+        int entry = tileLists.circles[i];
+        int circleIndex = static_cast<int>(entry & ~SUBPIXEL_CIRCLE_FLAG);
+
+        float px, py, rad;
+        circleGeometry(scene, circleIndex, px, py, rad);
+
+        int screenMinX, screenMinY, screenMaxX, screenMaxY;
+        if (entry & SUBPIXEL_CIRCLE_FLAG) {
+            // sub-pixel circle: go straight to the 2x2 candidate pixels
+            // (the item lies within the region)
+            subPixelCandidates(px, py, width, height, screenMinX, screenMinY);
+            screenMaxX = screenMinX + 2;
+            screenMaxY = screenMinY + 2;
+        } else {
+            float reach = antialias ? rad + coverageReach(width) : rad;
+            circleScreenBox(px, py, reach, width, height, regionMinX, regionMinY, regionMaxX, regionMaxY,
+                            screenMinX, screenMinY, screenMaxX, screenMaxY);
+        }
+
+        screenMinX = std::max(screenMinX, item.minX);
+        screenMaxX = std::min(screenMaxX, item.maxX);
+        screenMinY = std::max(screenMinY, item.minY);
+        screenMaxY = std::min(screenMaxY, item.maxY);
+
+        float maxDist = rad * rad;
+        float colR, colG, colB;
+        circleColor(scene, circleIndex, colR, colG, colB);
+        float alpha = .5f;
+        float oneMinusAlpha = 1.f - alpha;
+
+        if (antialias) {
+            // same as below, except that pixels in the ring around the
+            // edge blend with their fractional coverage (see
+            // RefRenderer::shadePixel).  Interior pixels skip the
+            // coverage computation
+            CoverageRing ring;
+            initCoverageRing(rad, width, ring);
+
+            for (int pixelY=screenMinY; pixelY<screenMaxY; pixelY++) {
+
+                float* imgPtr = &itemPixels[4 * ((pixelY - item.minY) * rowStride + screenMinX - item.minX)];
+                float pixelCenterNormY = invHeight * (static_cast<float>(pixelY) + 0.5f);
+
+                for (int pixelX=screenMinX; pixelX<screenMaxX; pixelX++) {
+
+                    float pixelCenterNormX = invWidth * (static_cast<float>(pixelX) + 0.5f);
+                    float diffX = px - pixelCenterNormX;
+                    float diffY = py - pixelCenterNormY;
+                    float pixelDist = diffX * diffX + diffY * diffY;
+
+                    if (pixelDist <= ring.innerDist2) {
+                        imgPtr[0] = alpha * colR + oneMinusAlpha * imgPtr[0];
+                        imgPtr[1] = alpha * colG + oneMinusAlpha * imgPtr[1];
+                        imgPtr[2] = alpha * colB + oneMinusAlpha * imgPtr[2];
+                        imgPtr[3] += alpha;
+                    } else if (pixelDist < ring.outerDist2) {
+                        float coverage = ringCoverage(ring, pixelDist);
+                        if (coverage > 0.f) {
+                            float edgeAlpha = .5f * coverage;
+                            float oneMinusEdgeAlpha = 1.f - edgeAlpha;
+                            imgPtr[0] = edgeAlpha * colR + oneMinusEdgeAlpha * imgPtr[0];
+                            imgPtr[1] = edgeAlpha * colG + oneMinusEdgeAlpha * imgPtr[1];
+                            imgPtr[2] = edgeAlpha * colB + oneMinusEdgeAlpha * imgPtr[2];
+                            imgPtr[3] += edgeAlpha;
+                        }
+                    }
+                    imgPtr += 4;
+                }
+            }
+            continue;
+        }
+
+        if (spanRadius > 0.f && rad * width >= spanRadius && !(entry & SUBPIXEL_CIRCLE_FLAG)) {
+            stats.spanRows += shadeSpans(px, py, rad, colR, colG, colB,
+                                         screenMinX, screenMinY, screenMaxX, screenMaxY);
+            continue;
+        }
+
+        for (int pixelY=screenMinY; pixelY<screenMaxY; pixelY++) {
+
+            float* imgPtr = &itemPixels[4 * ((pixelY - item.minY) * rowStride + screenMinX - item.minX)];
+            float pixelCenterNormY = invHeight * (static_cast<float>(pixelY) + 0.5f);
+
+            for (int pixelX=screenMinX; pixelX<screenMaxX; pixelX++) {
+
+                float pixelCenterNormX = invWidth * (static_cast<float>(pixelX) + 0.5f);
+                float diffX = px - pixelCenterNormX;
+                float diffY = py - pixelCenterNormY;
+                float pixelDist = diffX * diffX + diffY * diffY;
+
+                if (pixelDist <= maxDist) {
+                    imgPtr[0] = alpha * colR + oneMinusAlpha * imgPtr[0];
+                    imgPtr[1] = alpha * colG + oneMinusAlpha * imgPtr[1];
+                    imgPtr[2] = alpha * colB + oneMinusAlpha * imgPtr[2];
+                    imgPtr[3] += alpha;
+                }
+                imgPtr += 4;
+            }
+        }
+    }
+}
+
+// shadeSpans --
+//
+// Shades a circle over the box [minX, maxX) x [minY, maxY), one row
+// span at a time.  Along a row the distance test of renderItem holds
+// on a single run of pixels (every term of it is monotonic in the
+// distance to the center), so the run solved from the circle equation
+// only has to be corrected at its ends, with that same test, to cover
+// exactly the pixels renderItem would blend.  Returns the number of
+// non-empty rows.
+int
+TiledRenderer::shadeSpans(float px, float py, float rad, float colR, float colG, float colB,
+                          int minX, int minY, int maxX, int maxY) {
+
+    int width = image->width;
+    float invWidth = 1.f / width;
+    float invHeight = 1.f / image->height;
+    float maxDist = rad * rad;
+    float alpha = .5f;
+    float oneMinusAlpha = 1.f - alpha;
+    // pixel coordinate whose center is the circle center
+    float centerX = px * width - 0.5f;
+    int rows = 0;
+
+    for (int pixelY=minY; pixelY<maxY; pixelY++) {
+
+        float pixelCenterNormY = invHeight * (static_cast<float>(pixelY) + 0.5f);
+        float diffY = py - pixelCenterNormY;
+        float diffY2 = diffY * diffY;
+        if (diffY2 > maxDist)
+            continue;
+
+        auto inside = [&](int pixelX) {
+            float diffX = px - invWidth * (static_cast<float>(pixelX) + 0.5f);
+            return diffX * diffX + diffY2 <= maxDist;
+        };
+
+        float halfSpan = sqrtf(maxDist - diffY2) * width;
+        int spanMinX = CLAMP(static_cast<int>(ceilf(centerX - halfSpan)), minX, maxX);
+        int spanMaxX = CLAMP(static_cast<int>(floorf(centerX + halfSpan)) + 1, spanMinX, maxX);
+        while (spanMinX < spanMaxX && !inside(spanMinX))
+            spanMinX++;
+        while (spanMaxX > spanMinX && !inside(spanMaxX - 1))
+            spanMaxX--;
+        while (spanMinX > minX && inside(spanMinX - 1))
+            spanMinX--;
+        while (spanMaxX < maxX && inside(spanMaxX))
+            spanMaxX++;
+        if (spanMinX == spanMaxX)
+            continue;
+
+        float* imgPtr = &image->data[4 * image->pixelIndex(spanMinX, pixelY)];
+        for (int pixelX=spanMinX; pixelX<spanMaxX; pixelX++) {
+            imgPtr[0] = alpha * colR + oneMinusAlpha * imgPtr[0];
+            imgPtr[1] = alpha * colG + oneMinusAlpha * imgPtr[1];
+            imgPtr[2] = alpha * colB + oneMinusAlpha * imgPtr[2];
+            imgPtr[3] += alpha;
+            imgPtr += 4;
+        }
+        rows++;
+    }
+    return rows;
+}
+
+// printRenderStats --
+//
+// Per thread time spent binning and compositing in the last frame,
+// and how the tiles were distributed.
+void
+TiledRenderer::printRenderStats() {
+
+    double maxBusy = 0.f;
+    double sumBusy = 0.f;
+
+    printf("Thread  Bin(ms)     Busy(ms)    Items   Stolen\n");
+    for (size_t i=0; i<threadStats.size(); i++) {
+        const ThreadStats& stats = threadStats[i];
+        printf("%-7d %-11.4f %-11.4f %-7d %-7d\n", static_cast<int>(i),
+               1000.f * stats.binTime, 1000.f * stats.busyTime, stats.itemsDone, stats.itemsStolen);
+        maxBusy = std::max(maxBusy, stats.busyTime);
+        sumBusy += stats.busyTime;
+    }
+
+    double meanBusy = threadStats.empty() ? 0.f : sumBusy / threadStats.size();
+    printf("Work items: %d (%d tiles split), busy imbalance %.2fx (max / mean)\n",
+           static_cast<int>(workItems.size()), numSplitTiles, meanBusy > 0.f ? maxBusy / meanBusy : 1.f);
+
+    int subPixelCircles = 0;
+    int culledCircles = 0;
+    for (size_t i=0; i<threadStats.size(); i++) {
+        subPixelCircles += threadStats[i].subPixelCircles;
+        culledCircles += threadStats[i].culledCircles;
+    }
+    printf("Circles: %d sub-pixel (splatted), %d culled (zero radius or outside the region)\n",
+           subPixelCircles, culledCircles);
+    if (spanRadius > 0.f) {
+        int spanRows = 0;
+        for (size_t i=0; i<threadStats.size(); i++)
+            spanRows += threadStats[i].spanRows;
+        printf("Spans: %d circle rows shaded as spans (radius from %.1f pixels)\n", spanRows, spanRadius);
+    }
+    if (!binCacheDir.empty()) {
+        static const char* sources[] = { "binned", "binned and saved to the cache",
+                                         "mapped from the cache", "kept from the previous frame",
+                                         "binned, could not write the cache file" };
+        printf("Tile lists: %s\n", sources[listsSource]);
+    } else if (binUpdate.rebuilt && binUpdate.changedCircles < 0) {
+        printf("Bins: rebuilt in %.3f ms; %d rebuilds / %d updates so far\n",
+               1000.f * binUpdate.time, numRebuilds, numUpdates);
+    } else if (binUpdate.rebuilt) {
+        printf("Bins: rebuilt (%d circles changed tiles) in %.3f ms; %d rebuilds / %d updates so far\n",
+               binUpdate.changedCircles, 1000.f * binUpdate.time, numRebuilds, numUpdates);
+    } else {
+        printf("Bins: updated (%d circles changed tiles, %d tiles patched) in %.3f ms; %d rebuilds / %d updates so far\n",
+               binUpdate.changedCircles, binUpdate.patchedTiles, 1000.f * binUpdate.time, numRebuilds, numUpdates);
+    }
+
+    // traffic generated by the threads of every node, and the rate at
+    // which they generated it while busy
+    for (int node=0; node<topology.numNodes; node++) {
+        double local = 0.f, remote = 0.f, scene = 0.f, busy = 0.f;
+        int threads = 0;
+        for (size_t i=0; i<threadStats.size(); i++) {
+            if (threadNode[i] != node)
+                continue;
+            local += threadStats[i].localBytes;
+            remote += threadStats[i].remoteBytes;
+            scene += threadStats[i].sceneBytes;
+            busy += threadStats[i].busyTime;
+            threads++;
+        }
+        double seconds = threads > 0 ? busy / threads : 0.f;
+        printf("Node %d: %d threads, framebuffer %.1f MB local / %.1f MB remote, scene %.1f MB, %.2f GB/s\n",
+               node, threads, local / (1024 * 1024), remote / (1024 * 1024), scene / (1024 * 1024),
+               seconds > 0.f ? (local + remote + scene) / seconds / (1024 * 1024 * 1024) : 0.f);
+    }
+}
@@ -0,0 +1,328 @@
+#ifndef __TILED_RENDERER_H__
+#define __TILED_RENDERER_H__
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "binCache.h"
+#include "circleRenderer.h"
+#include "numaTopology.h"
+
+class WorkerPool;
+struct CompactScene;
+
+// default edge length of a square tile, in pixels (same as the CUDA
+// renderer's block size)
+#define DEFAULT_TILE_SIZE 32
+
+// the tile lists are rebuilt rather than patched when more than this
+// fraction of the circles changed tiles since the last frame
+#define DEFAULT_REBUILD_FRACTION 0.1f
+
+// circles with at least this radius, in pixels, are shaded row span by
+// row span instead of testing every pixel of their box.  Off unless the
+// planner (-r auto) chooses a radius
+#define DEFAULT_SPAN_RADIUS 0.f
+
+
+// TiledRenderer --
+//
+// Multithreaded CPU renderer.  Each frame is rendered in two passes:
+//
+//  1. binning: the circles are split in contiguous index ranges, one
+//     per thread, and every circle is appended to the list of each
+//     tile its screen bounding box overlaps.  A count pass, a prefix
+//     sum and a write pass keep every tile list in depth order.  The
+//     binning pass also estimates the cost of every tile, drops the
+//     circles that cannot cover anything, and marks the sub-pixel
+//     circles, which are splatted onto their few candidate pixels
+//     instead of going through the bounding box loop.
+//
+//  2. compositing: tiles are independent of each other, and are
+//     scheduled most expensive first on per-thread work-stealing
+//     deques.  Tiles that are much more expensive than the average
+//     are split into sub-tiles first.
+//
+// Within a tile, pixels are shaded exactly like in RefRenderer, so the
+// output is bit-identical to the reference (also when anti-aliasing).
+// Large circles are shaded one row span at a time: the span is solved
+// from the circle equation, then its ends are moved to where the exact
+// per pixel test changes, and the pixels in between are blended
+// without testing them.
+//
+// On NUMA hosts the worker threads are pinned to nodes in contiguous
+// groups, and every node owns a contiguous band of the framebuffer.
+// The framebuffer pages are first touched by the threads of the owning
+// node, tiles are dealt to the threads of the node that owns them (and
+// stolen within the node first), and every node reads its own copy of
+// the circle columns.
+//
+// With setCompactScene(true) the renderer keeps only a quantized copy of
+// the scene (see compactScene.h) and decodes it on the fly while
+// binning and shading, which shrinks the circle working set 3-4x at
+// the price of sub-pixel position and radius errors.
+//
+// When circles move between frames, the tile lists of the previous
+// frame are patched instead of rebuilt: every circle's screen box is
+// compared with the one it was binned with, and only the lists of the
+// tiles that circles entered or left are merged again (in depth order),
+// unless more than the rebuild fraction of the circles changed tiles.
+//
+// With setBinCacheDir() the tile lists are saved to (and later mapped
+// from) a cache file keyed by the scene, resolution, tile size and
+// region (see binCache.h), and reused in the following frames as long
+// as that key does not change.
+class TiledRenderer : public CircleRenderer {
+
+public:
+
+    // unit of work of the compositing pass: the pixels of a tile (or
+    // of a part of a tile) in [minX, maxX) x [minY, maxY)
+    struct WorkItem {
+        int tile;
+        int minX, minY, maxX, maxY;
+        float cost;
+    };
+
+    // per thread statistics of the last frame.  Framebuffer traffic is
+    // counted as one read and one write of every pixel of a work item,
+    // split by whether the pixels live on the thread's own node
+    struct ThreadStats {
+        double binTime;
+        double busyTime;
+        int itemsDone;
+        int itemsStolen;
+        double localBytes;
+        double remoteBytes;
+        double sceneBytes;
+        int subPixelCircles;
+        int culledCircles;
+        // circle rows shaded as spans
+        int spanRows;
+    };
+
+    // screen box a circle was binned with (clamped to the region), and
+    // whether it was culled or binned as a sub-pixel circle
+    struct CircleFootprint {
+        int minX, minY, maxX, maxY;
+        int flags;
+
+        bool operator==(const CircleFootprint& other) const {
+            return minX == other.minX && minY == other.minY && maxX == other.maxX && maxY == other.maxY &&
+                   flags == other.flags;
+        }
+    };
+
+    // circle data read by the threads of one NUMA node: the float
+    // columns, or the quantized scene in compact mode
+    struct SceneColumns {
+        const float* position;
+        const float* color;
+        const float* radius;
+        CompactScene* compact;
+    };
+
+private:
+
+    Image* image;
+    SceneName sceneName;
+
+    int numCircles;
+    const float* position;
+    const float* color;
+    const float* radius;
+    // false when the circle columns belong to the caller
+    bool ownsScene;
+
+    int tileSize;
+    // the framebuffer is stored tile by tile (Image::pixelIndex), with
+    // the tiles of the renderer
+    bool tiledLayout;
+    // pool size requested with setNumThreads, 0 for numWorkerThreads()
+    int requestedThreads;
+    WorkerPool* pool;
+
+    bool useCompactScene;
+    CompactScene* compactScene;
+    // the compact scene was over its error bound, the float scene is
+    // used instead
+    bool compactFallback;
+
+    bool antialias;
+    // radius in pixels from which circles are shaded as spans, 0: never
+    float spanRadius;
+
+    // tile hashes of the last frame (see tileSequence.h), and of the
+    // work items they are made of
+    bool hashTiles;
+    std::vector<uint64_t> tileHashes;
+    std::vector<uint64_t> itemHashes;
+
+    NumaTopology topology;
+    // NUMA node of every pool thread
+    std::vector<int> threadNode;
+    // copy of the scene used by every node (the loaded arrays
+    // themselves on single node hosts)
+    std::vector<SceneColumns> nodeScene;
+
+    // tile grid of the current frame
+    int tilesX;
+    int tilesY;
+
+    // tile lists, in CSR form: the circles of tile t are
+    // tileCircles[tileStart[t] .. tileStart[t+1]), with
+    // SUBPIXEL_CIRCLE_FLAG set on sub-pixel circles
+    std::vector<int> tileStart;
+    std::vector<int> tileCircles;
+
+    // estimated cost of every tile (pixel tests + per circle overhead)
+    std::vector<float> tileCost;
+
+    // screen box every circle was binned with, for incremental updates
+    std::vector<CircleFootprint> footprints;
+    // binning parameters of the footprints (sceneHash unused), valid
+    // if haveFootprints
+    BinCacheKey footprintKey;
+    bool haveFootprints;
+    float rebuildFraction;
+    // circles whose footprint changed this frame, per thread
+    std::vector<std::vector<std::pair<int, CircleFootprint> > > movedCircles;
+    // tile lists being patched, swapped with the ones above
+    std::vector<int> patchedStart;
+    std::vector<int> patchedCircles;
+
+    // how the tile lists of the last frame were maintained
+    struct BinUpdateStats {
+        bool rebuilt;
+        // circles that changed tiles, -1 for a rebuild without comparison
+        int changedCircles;
+        int patchedTiles;
+        double time;
+    };
+    BinUpdateStats binUpdate;
+    int numRebuilds;
+    int numUpdates;
+
+    // tile lists used by the frame: the vectors above, or a cache file
+    struct TileLists {
+        const int* start;
+        const float* cost;
+        const int* circles;
+    };
+    TileLists tileLists;
+
+    // bin cache directory, empty when disabled
+    std::string binCacheDir;
+    BinCacheFile binCacheFile;
+    // key of the tile lists in use, valid if haveListsKey
+    BinCacheKey listsKey;
+    bool haveListsKey;
+    // circle counts of the binning pass that built the lists in use
+    int listsSubPixelCircles;
+    int listsCulledCircles;
+    // hash of the scene geometry, computed once per scene
+    uint64_t sceneHash;
+    bool haveSceneHash;
+    // how the tile lists of the last frame were obtained
+    enum { LISTS_BUILT, LISTS_SAVED, LISTS_MAPPED, LISTS_REUSED, LISTS_NOT_SAVED } listsSource;
+
+    // per thread circle counts / cost per tile, used to place every
+    // thread's circles in the tile lists
+    std::vector<int> chunkTileCount;
+    std::vector<float> chunkTileCost;
+
+    std::vector<WorkItem> workItems;
+    std::vector<ThreadStats> threadStats;
+    int numSplitTiles;
+
+    void prepareTileLists(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+    BinCacheKey tileListsKey(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const;
+    void updateTileLists(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+    void patchTileLists();
+    void binCircles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+    void scheduleTiles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+    void compositeTiles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+    int shadeSpans(float px, float py, float rad, float colR, float colG, float colB,
+                   int minX, int minY, int maxX, int maxY);
+    void renderItem(const WorkItem& item, int thread, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+    void hashFrameTiles(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY);
+
+    void runOnNodes(const std::function<void(int)>& task);
+    void replicateScene();
+    void freeSceneReplicas();
+    void releaseScene();
+    void sceneChanged();
+    void buildCompact();
+    int pixelNode(long long pixelOffset) const;
+    bool imageLayoutChanged() const;
+
+public:
+
+    TiledRenderer();
+    virtual ~TiledRenderer();
+
+    const Image* getImage();
+
+    void setup();
+
+    void loadScene(SceneName name);
+
+    bool allocOutputImage(int width, int height);
+
+    bool setRenderResolution(int width, int height);
+
+    void clearImage();
+
+    void clearRegion(int minX, int minY, int maxX, int maxY);
+
+    void render();
+
+    void renderRegion(int minX, int minY, int maxX, int maxY);
+
+    void printRenderStats();
+
+    void printSetupInfo();
+
+    bool setSceneColumns(int numCircles, const float* position, const float* color, const float* radius);
+
+    bool setOutputBuffer(float* data, int width, int height);
+
+    bool setAntialias(bool enable);
+
+    bool enableTileHashes(int tileSize);
+
+    const uint64_t* getTileHashes();
+
+    void setTileSize(int size);
+
+    // number of worker threads of this renderer (0: numWorkerThreads()),
+    // before setup()
+    void setNumThreads(int numThreads);
+
+    void setCompactScene(bool compact);
+
+    // directory of the on-disk bin cache, NULL or "" to disable it
+    void setBinCacheDir(const char* directory);
+
+    // fraction of circles changing tiles above which the tile lists are
+    // rebuilt instead of patched (0: always rebuild)
+    void setRebuildFraction(float fraction);
+
+    // radius in pixels from which circles are shaded as row spans, 0
+    // for never (see planner.h)
+    void setSpanRadius(float pixels);
+
+    // stores our own framebuffer tile by tile instead of row by row; the
+    // output stage reads it back in row order (Image::rowPixels).
+    // Buffers given to setOutputBuffer stay linear
+    void setTiledLayout(bool tiled);
+
+    // signature of the loaded scene at the current resolution, the key
+    // of its tuning profiles (autotune.h)
+    std::string tuningSignature() const;
+};
+
+
+#endif
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "trace.h"
+
+#ifdef RENDER_TRACE
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+bool traceActive = false;
+
+struct TraceEvent {
+    const char* name;
+    const char* argName;
+    int arg;
+    CycleTimer::SysClock start;
+    CycleTimer::SysClock end;
+};
+
+// TraceBuffer --
+//
+// Ring of the zones of one thread.  Only the owning thread writes
+// events and count; count is published with release order so that
+// traceWrite() sees complete events.
+struct TraceBuffer {
+    int tid;
+    char name[32];
+    std::atomic<unsigned long long> count;
+    TraceEvent events[TRACE_RING_EVENTS];
+};
+
+// buffers are registered once per thread and never freed, the zones of
+// threads that exited are still written
+static std::mutex registryLock;
+static std::vector<TraceBuffer*> registry;
+static std::string traceFilename;
+static CycleTimer::SysClock traceBase;
+static double traceSecondsPerTick;
+
+static thread_local TraceBuffer* threadBuffer = NULL;
+
+static TraceBuffer*
+threadTraceBuffer() {
+
+    if (!threadBuffer) {
+        TraceBuffer* buffer = new TraceBuffer;
+        buffer->count.store(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> guard(registryLock);
+        buffer->tid = static_cast<int>(registry.size());
+        snprintf(buffer->name, sizeof(buffer->name), buffer->tid == 0 ? "main" : "thread %d", buffer->tid);
+        registry.push_back(buffer);
+        threadBuffer = buffer;
+    }
+    return threadBuffer;
+}
+
+void
+traceRecord(const char* name, const char* argName, int arg,
+            CycleTimer::SysClock start, CycleTimer::SysClock end) {
+
+    TraceBuffer* buffer = threadTraceBuffer();
+    unsigned long long count = buffer->count.load(std::memory_order_relaxed);
+
+    TraceEvent& event = buffer->events[count % TRACE_RING_EVENTS];
+    event.name = name;
+    event.argName = argName;
+    event.arg = arg;
+    event.start = start;
+    event.end = end;
+
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+static void
+traceWriteAtExit() {
+    traceWrite();
+}
+
+bool
+traceStart(const char* filename) {
+
+    traceFilename = filename;
+    traceSecondsPerTick = CycleTimer::secondsPerTick();
+    traceBase = CycleTimer::currentTicks();
+
+    // the calling thread is registered first, as "main"
+    threadTraceBuffer();
+    traceActive = true;
+
+    atexit(traceWriteAtExit);
+    return true;
+}
+
+void
+traceSetThreadName(const char* name, int index) {
+
+    if (!traceActive)
+        return;
+
+    TraceBuffer* buffer = threadTraceBuffer();
+    snprintf(buffer->name, sizeof(buffer->name), "%s %d", name, index);
+}
+
+void
+traceRestartInChild(const char* name, int index) {
+
+    if (!traceActive)
+        return;
+
+    std::string stem = traceFilename;
+    std::string extension;
+    size_t dot = stem.rfind('.');
+    if (dot != std::string::npos && stem.find('/', dot) == std::string::npos) {
+        extension = stem.substr(dot);
+        stem.resize(dot);
+    }
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), "_%s%d", name, index);
+    traceFilename = stem + suffix + extension;
+
+    // only the forking thread exists in the child, nothing else can
+    // be recording
+    for (size_t i=0; i<registry.size(); i++)
+        registry[i]->count.store(0, std::memory_order_relaxed);
+}
+
+// writeJsonString --
+//
+// Zone names are literals from the source, only quotes and backslashes
+// need escaping.
+static void
+writeJsonString(FILE* fp, const char* str) {
+    fputc('"', fp);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', fp);
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+void
+traceWrite() {
+
+    if (!traceActive)
+        return;
+
+    FILE* fp = fopen(traceFilename.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "Error: could not open trace file %s\n", traceFilename.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(registryLock);
+
+    int pid = static_cast<int>(getpid());
+    unsigned long long numEvents = 0;
+    unsigned long long numDropped = 0;
+    double microsPerTick = 1e6 * traceSecondsPerTick;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"render %d\"}}", pid, pid);
+
+    for (size_t i=0; i<registry.size(); i++) {
+
+        TraceBuffer* buffer = registry[i];
+        unsigned long long count = buffer->count.load(std::memory_order_acquire);
+        unsigned long long first = count > TRACE_RING_EVENTS ? count - TRACE_RING_EVENTS : 0;
+
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                pid, buffer->tid);
+        writeJsonString(fp, buffer->name);
+        fprintf(fp, "}}");
+        fprintf(fp, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+                pid, buffer->tid, buffer->tid);
+
+        for (unsigned long long e=first; e<count; e++) {
+
+            const TraceEvent& event = buffer->events[e % TRACE_RING_EVENTS];
+            double ts = (static_cast<long long>(event.start - traceBase)) * microsPerTick;
+            double dur = (event.end - event.start) * microsPerTick;
+
+            fprintf(fp, ",\n{\"name\":");
+            writeJsonString(fp, event.name);
+            fprintf(fp, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    pid, buffer->tid, ts, dur);
+            if (event.argName) {
+                fprintf(fp, ",\"args\":{");
+                writeJsonString(fp, event.argName);
+                fprintf(fp, ":%d}", event.arg);
+            }
+            fprintf(fp, "}");
+        }
+
+        numEvents += count - first;
+        numDropped += first;
+    }
+
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    printf("Wrote trace %s (%llu zones, %llu overwritten)\n",
+           traceFilename.c_str(), numEvents, numDropped);
+    fflush(stdout);
+}
+
+#else
+
+bool
+traceStart(const char* filename) {
+    fprintf(stderr, "Warning: built without tracing, rebuild with make TRACE=1 to write %s\n", filename);
+    return false;
+}
+
+void
+traceWrite() {
+}
+
+void
+traceRestartInChild(const char* name, int index) {
+}
+
+void
+traceSetThreadName(const char* name, int index) {
+}
+
+#endif
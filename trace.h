@@ -0,0 +1,100 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// Timeline of the render phases in the Chrome trace-event format, to
+// be opened in chrome://tracing or ui.perfetto.dev.
+//
+// Zones are only compiled in when RENDER_TRACE is defined (make
+// TRACE=1); otherwise TRACE_ZONE and TRACE_ZONE_ARG expand to nothing.
+// Even then nothing is recorded until traceStart() is called (--trace).
+// Every thread records its zones into its own ring buffer, which only
+// that thread writes, so recording takes no lock; once the ring is full
+// the oldest zones are overwritten.  The buffers are read back when the
+// trace is written, which must happen while no zone is being recorded
+// (at exit, or between frames).
+//
+//   void TiledRenderer::binCircles(...) {
+//       TRACE_ZONE("bin");
+//       ...
+//   }
+
+// zones kept per thread, the latest ones win
+#define TRACE_RING_EVENTS (1 << 16)
+
+// traceStart --
+//
+// Starts recording, the trace is written to filename at exit.  Returns
+// false (and records nothing) in builds without RENDER_TRACE.
+bool traceStart(const char* filename);
+
+// traceWrite --
+//
+// Writes the zones recorded so far to the trace file.  Called at exit,
+// processes that leave with _exit() call it themselves.
+void traceWrite();
+
+// traceRestartInChild --
+//
+// In a process forked after traceStart(): drops the zones inherited
+// from the parent and sends this process' zones to a file of its own,
+// "trace.json" becomes "trace_<name><index>.json".
+void traceRestartInChild(const char* name, int index);
+
+// traceSetThreadName --
+//
+// Names the calling thread in the timeline ("name index").
+void traceSetThreadName(const char* name, int index);
+
+
+#ifdef RENDER_TRACE
+
+#include "cycleTimer.h"
+
+extern bool traceActive;
+
+void traceRecord(const char* name, const char* argName, int arg,
+                 CycleTimer::SysClock start, CycleTimer::SysClock end);
+
+// TraceZone --
+//
+// Records the lifetime of the object as one zone.  name and argName
+// must be string literals (only the pointers are kept).
+class TraceZone {
+
+public:
+
+    explicit TraceZone(const char* zoneName, const char* zoneArgName = 0, int zoneArg = 0)
+        : name(zoneName), argName(zoneArgName), arg(zoneArg) {
+        start = traceActive ? CycleTimer::currentTicks() : 0;
+    }
+
+    ~TraceZone() {
+        if (start)
+            traceRecord(name, argName, arg, start, CycleTimer::currentTicks());
+    }
+
+private:
+
+    TraceZone(const TraceZone&);
+    TraceZone& operator=(const TraceZone&);
+
+    const char* name;
+    const char* argName;
+    int arg;
+    CycleTimer::SysClock start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_ZONE_ARG(name, argName, arg) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name, argName, arg)
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_ZONE_ARG(name, argName, arg)
+
+#endif
+
+
+#endif
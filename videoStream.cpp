@@ -0,0 +1,259 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "videoStream.h"
+#include "circleRenderer.h"
+#include "cycleTimer.h"
+#include "image.h"
+#include "parallel.h"
+#include "trace.h"
+#include "util.h"
+
+// rows converted per parallel chunk
+#define CONVERT_CHUNK_ROWS 32
+
+// how often the sustained frame rate is reported while streaming
+#define REPORT_INTERVAL_SECONDS 1.0
+
+// stdout of the process, once reserved for a video stream
+static int reservedStdout = -1;
+
+void
+reserveStdoutForVideo() {
+
+    if (reservedStdout >= 0)
+        return;
+
+    fflush(stdout);
+    reservedStdout = dup(STDOUT_FILENO);
+    if (reservedStdout >= 0)
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+VideoStream::VideoStream() {
+    fd = -1;
+    format = VIDEO_FORMAT_Y4M;
+    width = 0;
+    height = 0;
+    headerBytes = 0;
+    convertTime = 0.f;
+    writeTime = 0.f;
+    totalBytes = 0;
+}
+
+VideoStream::~VideoStream() {
+    close();
+}
+
+bool
+VideoStream::open(const char* path, VideoFormat streamFormat, int streamWidth, int streamHeight) {
+
+    close();
+
+    format = streamFormat;
+    width = streamWidth;
+    height = streamHeight;
+
+    // a reader closing the pipe must turn into a write error, not kill
+    // the process
+    signal(SIGPIPE, SIG_IGN);
+
+    if (strcmp(path, "-") == 0) {
+        reserveStdoutForVideo();
+        fd = reservedStdout;
+        reservedStdout = -1;
+    } else {
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: could not open %s for write: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    size_t frameBytes = 3 * static_cast<size_t>(width) * height;
+    const char* frameHeader = format == VIDEO_FORMAT_Y4M ? "FRAME\n" : "";
+    headerBytes = strlen(frameHeader);
+    buffer.resize(headerBytes + frameBytes);
+    memcpy(&buffer[0], frameHeader, headerBytes);
+
+    if (format == VIDEO_FORMAT_Y4M) {
+        char streamHeader[256];
+        int length = snprintf(streamHeader, sizeof(streamHeader), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+                              width, height, VIDEO_FRAME_RATE);
+        if (!writeAll(reinterpret_cast<unsigned char*>(streamHeader), length)) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+VideoStream::close() {
+
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+// writeAll --
+//
+// Blocking write of the whole buffer, across partial writes and
+// signals.
+bool
+VideoStream::writeAll(const unsigned char* data, size_t numBytes) {
+
+    TRACE_ZONE("write");
+    double startTime = CycleTimer::currentSeconds();
+
+    while (numBytes > 0) {
+        ssize_t written = write(fd, data, numBytes);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: video stream write failed: %s\n", strerror(errno));
+            return false;
+        }
+        data += written;
+        numBytes -= written;
+        totalBytes += written;
+    }
+
+    writeTime += CycleTimer::currentSeconds() - startTime;
+    return true;
+}
+
+// writeFrame --
+//
+// Converts the float image to 8 bits per channel exactly like
+// writePPMImage (top row first), then to YUV for Y4M, and writes it.
+bool
+VideoStream::writeFrame(const Image* image) {
+
+    if (fd < 0 || image->width != width || image->height != height)
+        return false;
+
+    TRACE_ZONE("encode");
+    double startTime = CycleTimer::currentSeconds();
+
+    unsigned char* pixels = &buffer[headerBytes];
+    size_t planeBytes = static_cast<size_t>(width) * height;
+
+    parallelFor(0, height, CONVERT_CHUNK_ROWS, [&](int begin, int end) {
+        std::vector<float> scratch(4 * width);
+        for (int row=begin; row<end; row++) {
+
+            const float* ptr = image->rowPixels(height - 1 - row, 0, width, &scratch[0]);
+            size_t offset = static_cast<size_t>(row) * width;
+
+            for (int i=0; i<width; i++) {
+
+                int r = static_cast<unsigned char>(255.f * CLAMP(ptr[0], 0.f, 1.f));
+                int g = static_cast<unsigned char>(255.f * CLAMP(ptr[1], 0.f, 1.f));
+                int b = static_cast<unsigned char>(255.f * CLAMP(ptr[2], 0.f, 1.f));
+                ptr += 4;
+
+                if (format == VIDEO_FORMAT_RGB24) {
+                    unsigned char* rgb = &pixels[3 * (offset + i)];
+                    rgb[0] = r;
+                    rgb[1] = g;
+                    rgb[2] = b;
+                } else {
+                    // BT.601, studio range, one plane per component
+                    pixels[offset + i] = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                    pixels[planeBytes + offset + i] = static_cast<unsigned char>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                    pixels[2 * planeBytes + offset + i] = static_cast<unsigned char>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+                }
+            }
+        }
+    });
+
+    convertTime += CycleTimer::currentSeconds() - startTime;
+
+    return writeAll(&buffer[0], buffer.size());
+}
+
+
+//This function renders frames and streams them as uncompressed video instead of saving one
+//image file per frame. The stream goes to a file, a named pipe, or stdout with "-", and can be
+//piped straight into an encoder. It is invoked with the option -V <y4m/rgb>, -f names the
+//destination. Without -b it streams until the reader closes the stream.
+//
+//Example: ./render -V y4m -f - rand10k | ffmpeg -i - out.mp4
+//         ./render -V rgb -f pipe -b 300 rgb     (with ffmpeg -f rawvideo -pix_fmt rgb24 -s 1024x1024 -i pipe)
+void
+startVideoStream(
+    CircleRenderer* renderer,
+    int totalFrames,
+    const std::string& path,
+    VideoFormat format,
+    const int* region)
+{
+    const Image* image = renderer->getImage();
+
+    VideoStream stream;
+    if (!stream.open(path.c_str(), format, image->width, image->height))
+        exit(1);
+
+    printf("\nStreaming %s video (%dx%d) to %s\n", format == VIDEO_FORMAT_Y4M ? "y4m" : "raw rgb24",
+           image->width, image->height, path.compare("-") == 0 ? "stdout" : path.c_str());
+
+    double startTime = CycleTimer::currentSeconds();
+    double lastReportTime = startTime;
+    double renderTime = 0.f;
+    int lastReportFrame = 0;
+    int frame;
+
+    for (frame=0; totalFrames < 0 || frame<totalFrames; frame++) {
+
+        TRACE_ZONE_ARG("frame", "frame", frame);
+        double startRenderTime = CycleTimer::currentSeconds();
+
+        renderer->clearImage();
+        if (region)
+            renderer->renderRegion(region[0], region[1], region[2], region[3]);
+        else
+            renderer->render();
+
+        renderTime += CycleTimer::currentSeconds() - startRenderTime;
+
+        if (!stream.writeFrame(renderer->getImage()))
+            break;
+
+        double now = CycleTimer::currentSeconds();
+        if (now - lastReportTime >= REPORT_INTERVAL_SECONDS) {
+            printf("Frame %d: %.1f frames/s\n", frame + 1, (frame + 1 - lastReportFrame) / (now - lastReportTime));
+            fflush(stdout);
+            lastReportTime = now;
+            lastReportFrame = frame + 1;
+        }
+    }
+
+    stream.close();
+
+    double totalTime = CycleTimer::currentSeconds() - startTime;
+    int framesWritten = frame;
+
+    printf("\n");
+    printf("Streamed: %d frames, %.1f MB\n", framesWritten, stream.bytesWritten() / (1024.0 * 1024.0));
+    if (framesWritten > 0) {
+        printf("Sustained: %.2f frames/s\n", framesWritten / totalTime);
+        printf("Render:   %.4f ms/frame\n", 1000.f * renderTime / framesWritten);
+        printf("Convert:  %.4f ms/frame\n", 1000.f * stream.convertSeconds() / framesWritten);
+        printf("Write:    %.4f ms/frame (includes waiting for the reader)\n", 1000.f * stream.writeSeconds() / framesWritten);
+    }
+    printf("Overall:  %.4f sec (note units are seconds)\n", totalTime);
+
+    // without a frame count the stream normally ends when the reader
+    // goes away
+    if (totalFrames >= 0 && framesWritten < totalFrames)
+        exit(1);
+}
@@ -0,0 +1,79 @@
+#ifndef __VIDEO_STREAM_H__
+#define __VIDEO_STREAM_H__
+
+#include <stddef.h>
+#include <vector>
+
+struct Image;
+
+typedef enum {
+    VIDEO_FORMAT_Y4M,
+    VIDEO_FORMAT_RGB24
+} VideoFormat;
+
+// frame rate written in the Y4M header
+#define VIDEO_FRAME_RATE 30
+
+// reserveStdoutForVideo --
+//
+// Keeps the process' stdout for a video stream opened later on "-",
+// and sends everything printed from now on to stderr instead.  Call it
+// before anything is printed.
+void reserveStdoutForVideo();
+
+
+// VideoStream --
+//
+// Writes a sequence of frames to a file, a named pipe or stdout as one
+// uncompressed video stream, either YUV4MPEG2 (4:4:4, BT.601) or raw
+// RGB24, for an external encoder to consume.  Every frame is converted
+// into the same buffer and written with blocking writes, so a slow
+// reader throttles the renderer instead of frames being dropped.
+class VideoStream {
+
+public:
+
+    VideoStream();
+    ~VideoStream();
+
+    // Opens the stream; "-" is stdout (see reserveStdoutForVideo,
+    // which is called here if it was not before).  Opening a named
+    // pipe waits for a reader.
+    bool open(const char* path, VideoFormat format, int width, int height);
+
+    // Converts and writes one frame.  Returns false if the stream
+    // could not be written (for example if the reader went away).
+    bool writeFrame(const Image* image);
+
+    void close();
+
+    // time spent converting frames, and waiting for the reader in
+    // write(), in seconds
+    double convertSeconds() const { return convertTime; }
+    double writeSeconds() const { return writeTime; }
+
+    size_t bytesWritten() const { return totalBytes; }
+
+private:
+
+    VideoStream(const VideoStream&);
+    VideoStream& operator=(const VideoStream&);
+
+    bool writeAll(const unsigned char* data, size_t numBytes);
+
+    int fd;
+    VideoFormat format;
+    int width;
+    int height;
+
+    // conversion buffer: frame header (Y4M), then the pixel data
+    std::vector<unsigned char> buffer;
+    size_t headerBytes;
+
+    double convertTime;
+    double writeTime;
+    size_t totalBytes;
+};
+
+
+#endif
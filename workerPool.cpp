@@ -0,0 +1,96 @@
+#include <algorithm>
+
+#include "workerPool.h"
+#include "trace.h"
+
+static int workerThreadOverride = 0;
+
+int
+numWorkerThreads() {
+
+    if (workerThreadOverride > 0)
+        return workerThreadOverride;
+
+    unsigned int n = std::thread::hardware_concurrency();
+    return (n > 0) ? static_cast<int>(n) : 1;
+}
+
+void
+setNumWorkerThreads(int numThreads) {
+    workerThreadOverride = std::max(numThreads, 0);
+}
+
+WorkerPool::WorkerPool(int numThreads) {
+
+    this->numThreads = std::max(numThreads, 1);
+    currentTask = NULL;
+    generation = 0;
+    pending = 0;
+    stopping = false;
+
+    for (int i=1; i<this->numThreads; i++)
+        threads.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+}
+
+WorkerPool::~WorkerPool() {
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+
+    for (size_t i=0; i<threads.size(); i++)
+        threads[i].join();
+}
+
+void
+WorkerPool::run(const std::function<void(int)>& task) {
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        currentTask = &task;
+        pending = numThreads - 1;
+        generation++;
+    }
+    wakeWorkers.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    workersDone.wait(guard, [this]() { return pending == 0; });
+    currentTask = NULL;
+}
+
+// workerLoop --
+//
+// Sleep until run() publishes a new task (a new generation), run it,
+// and report back.
+void
+WorkerPool::workerLoop(int threadIndex) {
+
+    traceSetThreadName("worker", threadIndex);
+
+    unsigned int seenGeneration = 0;
+
+    while (true) {
+
+        const std::function<void(int)>* task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeWorkers.wait(guard, [&]() { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+            task = currentTask;
+        }
+
+        (*task)(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            pending--;
+        }
+        workersDone.notify_one();
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// numWorkerThreads --
+//
+// Number of host threads used by parallel loops and worker pools.
+// Defaults to the number of hardware threads.
+int numWorkerThreads();
+
+// setNumWorkerThreads --
+//
+// Override the number of worker threads (0 restores the default).
+// Affects pools created afterwards.
+void setNumWorkerThreads(int numThreads);
+
+
+// WorkerPool --
+//
+// A fixed set of threads that are kept alive between frames.  run()
+// executes the same task once on every thread, passing it the index
+// of the thread, so the task can pick its share of the work.  The
+// calling thread takes part as thread 0.
+class WorkerPool {
+
+public:
+
+    explicit WorkerPool(int numThreads);
+    ~WorkerPool();
+
+    int size() const { return numThreads; }
+
+    // runs task(threadIndex) for every threadIndex in [0, size()),
+    // returns once all of them are done
+    void run(const std::function<void(int)>& task);
+
+private:
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void workerLoop(int threadIndex);
+
+    int numThreads;
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable wakeWorkers;
+    std::condition_variable workersDone;
+    const std::function<void(int)>* currentTask;
+    unsigned int generation;
+    int pending;
+    bool stopping;
+};
+
+
+#endif